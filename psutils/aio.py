@@ -0,0 +1,183 @@
+"""
+PSUtils asyncio API.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+stream runs a function of psutils.api on a document read from an
+asynchronous iterator of bytes, and yields the output as it is written.
+The event loop reads the input and takes the output, while the work is done
+on a thread of a pool kept for streams, so that streams neither wait for
+nor hold up the loop's default executor; at most MAX_STREAMS documents are
+processed at once, and others wait for a thread. The queues between the
+loop and the thread are bounded, so a PostScript document is read and
+written without holding all of it in memory.
+"""
+
+import asyncio
+import contextvars
+import functools
+import io
+from concurrent.futures import ThreadPoolExecutor
+from typing import Any, AsyncIterable, AsyncIterator, Callable, Optional, Set, Union
+
+__all__ = ["stream"]
+
+# The size of output chunks
+CHUNK_SIZE = 65536
+
+# How many input or output chunks may be waiting to be taken
+QUEUE_DEPTH = 8
+
+# How many documents may be processed at once
+MAX_STREAMS = 32
+
+
+# Return the pool of threads that process documents, started when first
+# needed.
+@functools.lru_cache(maxsize=None)
+def stream_executor() -> ThreadPoolExecutor:
+    return ThreadPoolExecutor(MAX_STREAMS, thread_name_prefix="psutils-aio")
+
+
+# A chunk of input, or an empty chunk at its end, or the error that ended it
+InputItem = Union[bytes, BaseException]
+
+
+class AsyncInput(io.RawIOBase):
+    """A file whose data is taken, on a worker thread, from `chunks', a
+    queue served by `loop' and filled by feed."""
+
+    def __init__(
+        self,
+        loop: asyncio.AbstractEventLoop,
+        chunks: "asyncio.Queue[InputItem]",
+    ) -> None:
+        super().__init__()
+        self.loop = loop
+        self.chunks = chunks
+        self.data = b""
+        self.eof = False
+        self.cancelled = False
+
+    def readable(self) -> bool:
+        return True
+
+    def readinto(self, buffer: Any) -> int:
+        while len(self.data) == 0 and not self.eof:
+            if self.cancelled:
+                raise BrokenPipeError("output no longer wanted")
+            item = asyncio.run_coroutine_threadsafe(
+                self.chunks.get(), self.loop
+            ).result()
+            if isinstance(item, BaseException):
+                raise item
+            self.data = item
+            self.eof = len(item) == 0
+        n = min(len(buffer), len(self.data))
+        buffer[:n] = self.data[:n]
+        self.data = self.data[n:]
+        return n
+
+
+class AsyncOutput(io.RawIOBase):
+    """A file whose data is put, from a worker thread, on to `chunks', a
+    queue served by `loop'. Writing blocks while the queue is full."""
+
+    def __init__(
+        self,
+        loop: asyncio.AbstractEventLoop,
+        chunks: "asyncio.Queue[bytes]",
+    ) -> None:
+        super().__init__()
+        self.loop = loop
+        self.chunks = chunks
+        self.written = 0
+        self.cancelled = False
+
+    def writable(self) -> bool:
+        return True
+
+    def write(self, data: Any) -> int:
+        if self.cancelled:
+            raise BrokenPipeError("output no longer wanted")
+        chunk = bytes(data)
+        asyncio.run_coroutine_threadsafe(self.chunks.put(chunk), self.loop).result()
+        self.written += len(chunk)
+        return len(chunk)
+
+    # PDF output needs its position, which is the number of bytes written
+    def tell(self) -> int:
+        return self.written
+
+
+# Put the chunks of `source' on `chunks', followed by an empty chunk, or the
+# error that ended it.
+async def feed(
+    source: AsyncIterable[bytes], chunks: "asyncio.Queue[InputItem]"
+) -> None:
+    try:
+        async for chunk in source:
+            if len(chunk) > 0:
+                await chunks.put(chunk)
+    except Exception as e:  # pylint: disable=broad-exception-caught
+        await chunks.put(e)
+        return
+    await chunks.put(b"")
+
+
+async def stream(
+    function: Callable[..., Optional[bytes]],
+    source: AsyncIterable[bytes],
+    *args: Any,
+    **kwargs: Any,
+) -> AsyncIterator[bytes]:
+    """Run `function', one of the functions of psutils.api, with the
+    document read from `source' and the given arguments, and yield its
+    output in chunks. Errors, such as PsutilsError, are raised once the
+    output written before them has been yielded. Closing the iterator
+    early stops the work."""
+    loop = asyncio.get_running_loop()
+    input_chunks: "asyncio.Queue[InputItem]" = asyncio.Queue(QUEUE_DEPTH)
+    chunks: "asyncio.Queue[bytes]" = asyncio.Queue(QUEUE_DEPTH)
+    infile = AsyncInput(loop, input_chunks)
+    outfile = AsyncOutput(loop, chunks)
+
+    def run() -> None:
+        with io.BufferedReader(infile) as reader:
+            with io.BufferedWriter(outfile, CHUNK_SIZE) as writer:
+                function(reader, *args, output=writer, **kwargs)
+
+    # Run `run' in a copy of this context, as asyncio.to_thread does, so
+    # that it reports to the caller's diagnostics.
+    context = contextvars.copy_context()
+    feeder = asyncio.ensure_future(feed(source, input_chunks))
+    task = asyncio.ensure_future(
+        loop.run_in_executor(stream_executor(), functools.partial(context.run, run))
+    )
+    try:
+        while True:
+            get = asyncio.ensure_future(chunks.get())
+            waiting: Set["asyncio.Future[Any]"] = {get, task}
+            done, _ = await asyncio.wait(waiting, return_when=asyncio.FIRST_COMPLETED)
+            if get in done:
+                yield get.result()
+                continue
+            get.cancel()
+            # Every write has been queued by the time `run' returns
+            while not chunks.empty():
+                yield chunks.get_nowait()
+            task.result()
+            return
+    finally:
+        feeder.cancel()
+        if not task.done():
+            # Stop the worker at its next read or write, and let any read or
+            # write it is waiting on finish
+            infile.cancelled = outfile.cancelled = True
+            while not task.done():
+                while not chunks.empty():
+                    chunks.get_nowait()
+                if input_chunks.empty():
+                    input_chunks.put_nowait(BrokenPipeError("output no longer wanted"))
+                await asyncio.wait({task}, timeout=0.01)
+            task.exception()
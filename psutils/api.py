@@ -0,0 +1,200 @@
+"""
+PSUtils library API.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+Each function transforms a PDF or PostScript document as the command of
+the same purpose does. The document may be given as a file name, its
+contents (for example, bytes or an mmap), or a binary file object. The
+result is written to `output', a file name or binary file object, or, if
+that is None, returned as bytes. Errors raise PsutilsError rather than
+exiting, and no progress messages are written; warnings go to standard
+error, or to the sink given with psutils.warnings.report_to, which, like
+all the state of a call, is local to the calling thread, so that calls may
+run concurrently on several threads.
+"""
+
+import argparse
+import io
+import os
+from typing import IO, Callable, List, Optional, Union
+
+from .command import psbook, psnup, psselect, pstops
+from .io import Source, setup_source, write_output
+from .pipeline import Pipeline
+from .readers import PdfReader, PsReader, document_reader
+from .types import Rectangle
+from .warnings import PsutilsError, die, raise_errors
+
+__all__ = [
+    "PsutilsError",
+    "Source",
+    "Sink",
+    "select",
+    "book",
+    "impose",
+    "nup",
+    "resize",
+    "pipe",
+]
+
+# Where to write a document: a file name or a binary file object
+Sink = Union[str, "os.PathLike[str]", IO[bytes]]
+
+# A paper size: a name such as "a4", dimensions such as "21cm x 29.7cm"
+# without the spaces, or a Rectangle in points
+Paper = Union[str, Rectangle]
+
+Document = Union[PdfReader, PsReader]
+
+
+# Return the arguments that give `paper' to `option'.
+def paper_argv(option: str, paper: Optional[Paper]) -> List[str]:
+    if paper is None:
+        return []
+    if isinstance(paper, Rectangle):
+        paper = f"{paper.width}x{paper.height}"
+    return [f"{option}={paper}"]
+
+
+# Return the arguments that set the flags in `flags' that are true.
+def flag_argv(**flags: bool) -> List[str]:
+    return [f"--{name.replace('_', '-')}" for name, value in flags.items() if value]
+
+
+# Read `source', and write it to `output' with `write', using the arguments
+# parsed from `argv' by `get_args'.
+def transform(
+    source: Source,
+    output: Optional[Sink],
+    get_args: Callable[[List[str]], argparse.Namespace],
+    write: Callable[[Document, argparse.Namespace, IO[bytes]], None],
+    argv: List[str],
+) -> Optional[bytes]:
+    with raise_errors():
+        args = get_args(["--quiet", *argv])
+        with setup_source(source) as (infile, file_type):
+            doc = document_reader(infile, file_type)
+            if output is None:
+                buffer = io.BytesIO()
+                write(doc, args, buffer)
+                return buffer.getvalue()
+            if isinstance(output, (str, os.PathLike)):
+                write_output(
+                    os.fspath(output), lambda outfile: write(doc, args, outfile)
+                )
+            else:
+                write(doc, args, output)
+    return None
+
+
+def select(
+    source: Source,
+    pages: Optional[str] = None,
+    *,
+    reverse: bool = False,
+    odd: bool = False,
+    even: bool = False,
+    prune_resources: bool = False,
+    output: Optional[Sink] = None,
+) -> Optional[bytes]:
+    """Select pages, as psselect does; `pages' is a comma-separated list of
+    pages and page ranges."""
+    argv = [] if pages is None else [f"--pages={pages}"]
+    argv += flag_argv(
+        reverse=reverse, odd=odd, even=even, prune_resources=prune_resources
+    )
+    return transform(source, output, psselect.get_args, psselect.select, argv)
+
+
+def book(
+    source: Source, signature: int = 0, *, output: Optional[Sink] = None
+) -> Optional[bytes]:
+    """Rearrange pages into signatures of `signature' pages, or one
+    signature for the whole document if 0, as psbook does."""
+    return transform(
+        source, output, psbook.get_args, psbook.bind, [f"--signature={signature}"]
+    )
+
+
+def impose(
+    source: Source,
+    specs: str = pstops.DEFAULT_SPECS,
+    *,
+    paper: Optional[Paper] = None,
+    inpaper: Optional[Paper] = None,
+    pages: Optional[str] = None,
+    reverse: bool = False,
+    odd: bool = False,
+    even: bool = False,
+    draw: float = 0,
+    output: Optional[Sink] = None,
+) -> Optional[bytes]:
+    """Rearrange pages according to `specs', as pstops does; `draw' is the
+    width in points of a line to draw around each page, or 0 for none."""
+    argv = [f"--specs={specs}", f"--draw={draw}"]
+    argv += paper_argv("--paper", paper) + paper_argv("--inpaper", inpaper)
+    if pages is not None:
+        argv.append(f"--pages={pages}")
+    argv += flag_argv(reverse=reverse, odd=odd, even=even)
+    return transform(source, output, pstops.get_args, pstops.rearrange, argv)
+
+
+def nup(
+    source: Source,
+    n: int,
+    *,
+    paper: Optional[Paper] = None,
+    inpaper: Optional[Paper] = None,
+    margin: float = 0,
+    border: float = 0,
+    draw: float = 0,
+    rotatedleft: bool = False,
+    rotatedright: bool = False,
+    flip: bool = False,
+    transpose: bool = False,
+    tolerance: int = 100_000,
+    output: Optional[Sink] = None,
+) -> Optional[bytes]:
+    """Put `n' pages on to each sheet, as psnup does; dimensions are in
+    points."""
+    if n < 1:
+        with raise_errors():
+            die("number of pages per sheet must be greater than 0")
+    argv = [f"-{n}", f"--margin={margin}", f"--border={border}", f"--draw={draw}"]
+    argv += paper_argv("--paper", paper) + paper_argv("--inpaper", inpaper)
+    argv.append(f"--tolerance={tolerance}")
+    argv += flag_argv(
+        rotatedleft=rotatedleft,
+        rotatedright=rotatedright,
+        flip=flip,
+        transpose=transpose,
+    )
+    return transform(source, output, psnup.get_args, psnup.impose, argv)
+
+
+def resize(
+    source: Source,
+    paper: Paper,
+    *,
+    inpaper: Optional[Paper] = None,
+    output: Optional[Sink] = None,
+) -> Optional[bytes]:
+    """Resize pages to `paper', as psresize does."""
+    return nup(source, 1, paper=paper, inpaper=inpaper, output=output)
+
+
+def pipe(
+    source: Source, commands: str, *, output: Optional[Sink] = None
+) -> Optional[bytes]:
+    """Run a pipeline of commands, as pspipe does, for example
+    `psselect 1-16 | psbook -s8 | psnup -2'."""
+    with raise_errors():
+        pipeline = Pipeline(commands)
+    return transform(
+        source,
+        output,
+        lambda argv: argparse.Namespace(),
+        lambda doc, args, outfile: pipeline.run(doc, outfile, False),
+        [],
+    )
@@ -7,6 +7,7 @@ Released under the GPL version 3, or (at your option) any later version.
 import importlib.metadata
 import argparse
 import re
+import shlex
 from typing import List, Tuple, Optional, Callable, NoReturn
 
 from .libpaper import get_paper_size
@@ -63,9 +64,17 @@ def dimension(s: str) -> float:
     return float(m[1]) * units[m[2]]
 
 
-class PaperContext:  # pylint: disable=too-few-public-methods
-    def __init__(self, size: Optional[Rectangle] = get_paper_size()) -> None:
-        self.default_paper = size
+class PaperContext:
+    # The default paper size is looked up when it is first needed, if `size'
+    # is not given.
+    def __init__(self, size: Optional[Rectangle] = None) -> None:
+        self.size = size
+
+    @property
+    def default_paper(self) -> Optional[Rectangle]:
+        if self.size is None:
+            self.size = get_paper_size()
+        return self.size
 
     def dimension(
         self,
@@ -277,3 +286,154 @@ draw a line of given width (relative to original
 page) around each page [argument defaults to 1pt;
 default is no line; width is fixed for PDF]""",
     )
+
+
+def add_procset_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--light-procset",
+        action="store_true",
+        help="""\
+use a smaller PostScript procset that does not
+redefine initclip; only for input documents that
+do not call initclip or initgraphics""",
+    )
+
+
+# Return a function that parses a whole number of `things', at least
+# `minimum', for use as the type of an argument.
+def count_type(things: str, minimum: int) -> Callable[[str], int]:
+    def parse(s: str) -> int:
+        try:
+            n = int(s)
+        except ValueError:
+            n = minimum - 1
+        if n < minimum:
+            die(f"`{s}' is not a valid number of {things}")
+        return n
+
+    return parse
+
+
+jobs = count_type("jobs", 1)
+connections = count_type("connections", 1)
+byte_size = count_type("bytes", 0)
+split_size = count_type("pages", 1)
+
+
+def add_jobs_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "-j",
+        "--jobs",
+        metavar="NUMBER",
+        type=jobs,
+        default=1,
+        help="number of processes to write output pages with [default 1]",
+    )
+
+
+def add_split_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--split",
+        metavar="NUMBER",
+        type=split_size,
+        default=0,
+        help="""\
+write each NUMBER output pages to a separate
+document, named by OUTFILE with %%d replaced by the
+document's number, counting from 1; the documents
+are written concurrently""",
+    )
+
+
+def add_page_labels_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--page-labels",
+        action="store_true",
+        help="show the label of each page as it is written",
+    )
+
+
+def add_stats_argument(parser: argparse.ArgumentParser) -> None:
+    # FILE is a separate option, as an optional argument of --stats would
+    # take the input file name when it came before it
+    parser.add_argument(
+        "--stats",
+        action="store_const",
+        const="",
+        help="write performance statistics as JSON to standard error",
+    )
+    parser.add_argument(
+        "--stats-file",
+        metavar="FILE",
+        dest="stats",
+        help="write performance statistics as JSON to FILE",
+    )
+
+
+def add_cache_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--cache-dir",
+        metavar="DIRECTORY",
+        help="""\
+keep the output in DIRECTORY, and copy it from
+there when the same input is given with the same
+options""",
+    )
+
+
+def add_incremental_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--incremental",
+        action="store_true",
+        help="""\
+record a hash of each input page and output page
+beside OUTFILE, and copy output pages whose input
+pages and options are unchanged from the previous
+OUTFILE""",
+    )
+
+
+def add_pipeline_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--pipeline",
+        action="store_true",
+        help="""\
+read, build and write PostScript output pages in
+separate threads, to overlap input and output""",
+    )
+
+
+def add_append_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--append",
+        metavar="FILE",
+        action="append",
+        default=[],
+        help="""\
+follow the pages of INFILE with those of FILE, as
+if the files were joined; may be given more than
+once""",
+    )
+
+
+def add_fan_out_argument(parser: argparse.ArgumentParser) -> None:
+    parser.add_argument(
+        "--fan-out",
+        metavar="'OPTION... OUTFILE'",
+        action="append",
+        default=[],
+        help="""\
+also write OUTFILE from the same input, using the
+given options instead of the others on the command
+line; may be given more than once; write
+--fan-out='-OPTION... OUTFILE' if the first option
+starts with `-'""",
+    )
+
+
+# Return the command line for a --fan-out argument `text', reading `infile'.
+def fan_out_argv(text: str, infile: Optional[str]) -> List[str]:
+    words = shlex.split(text)
+    if len(words) == 0:
+        die("--fan-out needs an output file")
+    return [*words[:-1], infile or "-", words[-1]]
@@ -0,0 +1,188 @@
+"""
+PSUtils batch processing.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+"""
+
+import concurrent.futures
+import contextlib
+import io
+import json
+import multiprocessing
+import os
+import sys
+import time
+from concurrent.futures.process import BrokenProcessPool
+from dataclasses import asdict, dataclass, field
+from typing import Any, Callable, Dict, IO, Iterable, Iterator, List, Optional
+
+from .command.epsffit import epsffit
+from .command.psbook import psbook
+from .command.psnup import psnup
+from .command.pspipe import pspipe
+from .command.psresize import psresize
+from .command.psselect import psselect
+from .command.pstops import pstops
+from .libpaper import get_paper_size
+
+# The commands that a job can run
+COMMANDS: Dict[str, Callable[[List[str]], None]] = {
+    "epsffit": epsffit,
+    "psbook": psbook,
+    "psnup": psnup,
+    "pspipe": pspipe,
+    "psresize": psresize,
+    "psselect": psselect,
+    "pstops": pstops,
+}
+
+
+@dataclass
+class Job:
+    id: str
+    command: str
+    args: List[str] = field(default_factory=list)
+    input: Optional[str] = None
+    output: Optional[str] = None
+
+
+@dataclass
+class JobResult:
+    id: str
+    command: str
+    # 0 if the job succeeded, otherwise the command's exit status
+    status: int
+    seconds: float
+    # What the command wrote to standard error
+    messages: str
+
+
+# Parse manifest line `n', a JSON object with keys `command', `args',
+# `input', `output' and, optionally, `id'. Standard output carries the
+# report, so cannot be a job's output.
+def parse_job(n: int, line: str) -> Job:
+    return make_job(str(n), json.loads(line))
+
+
+# Make a job from `fields', as parsed by parse_job, with the id `default_id'
+# if it has none.
+def make_job(default_id: str, fields: Any) -> Job:
+    if not isinstance(fields, dict):
+        raise ValueError("job is not a JSON object")
+    job = Job(str(fields.pop("id", default_id)), **fields)
+    if job.command not in COMMANDS:
+        raise ValueError(f"unknown command `{job.command}'")
+    if not isinstance(job.args, list) or not all(
+        isinstance(arg, str) for arg in job.args
+    ):
+        raise ValueError("args must be a list of strings")
+    if job.input is None or job.output is None:
+        raise ValueError("a job needs an input and an output")
+    if job.output == "-":
+        raise ValueError("a job cannot write to standard output")
+    return job
+
+
+# Run `job', capturing its messages, and return its result. A command that
+# fails does so by calling die, which raises SystemExit.
+def run_job(job: Job) -> JobResult:
+    messages = io.StringIO()
+    start = time.perf_counter()
+    status = 0
+    # Commands name themselves in messages after sys.argv[0]
+    argv = sys.argv
+    sys.argv = [job.command]
+    with contextlib.redirect_stderr(messages):
+        try:
+            assert job.input is not None and job.output is not None
+            COMMANDS[job.command]([*job.args, job.input, job.output])
+        except SystemExit as e:
+            status = e.code if isinstance(e.code, int) else 1
+        except Exception as e:  # pylint: disable=broad-exception-caught
+            print(f"{job.command}: {e}", file=messages)
+            status = 2
+        finally:
+            sys.argv = argv
+    return JobResult(
+        job.id, job.command, status, time.perf_counter() - start, messages.getvalue()
+    )
+
+
+# Run the jobs in `manifest', lines of JSON as read by parse_job, with `jobs'
+# worker processes, or one per processor if None, and yield their results as
+# they finish. A line that is not a valid job gives a failed result, and does
+# not stop the batch; nor does a job that kills its worker process.
+def run_batch(manifest: Iterable[str], jobs: Optional[int]) -> Iterator[JobResult]:
+    # Look up the default paper size before starting the workers, so that
+    # they share it; command modules are already imported.
+    get_paper_size()
+    context = multiprocessing.get_context("fork")
+    workers = jobs if jobs is not None else (os.cpu_count() or 1)
+    executor = concurrent.futures.ProcessPoolExecutor(workers, context)
+    # Jobs are started as workers become free, so that when a worker dies,
+    # only the jobs then running are interrupted
+    running: Dict["concurrent.futures.Future[JobResult]", Job] = {}
+    interrupted: List[Job] = []
+
+    def collect(return_when: str) -> Iterator[JobResult]:
+        done, _ = concurrent.futures.wait(running, return_when=return_when)
+        for future in done:
+            job = running.pop(future)
+            try:
+                yield future.result()
+            except BrokenProcessPool:
+                interrupted.append(job)
+
+    # Wait for jobs to finish as collect does. If a worker has died, the
+    # pool cannot be used again, and every job running in it fails; rerun
+    # each of those jobs on its own in a new pool, so that only the one that
+    # killed its worker is reported as failed.
+    def finish(return_when: str) -> Iterator[JobResult]:
+        nonlocal executor
+        yield from collect(return_when)
+        if len(interrupted) == 0:
+            return
+        yield from collect(concurrent.futures.ALL_COMPLETED)
+        broken = True
+        while len(interrupted) > 0:
+            if broken:
+                executor.shutdown()
+                executor = concurrent.futures.ProcessPoolExecutor(workers, context)
+                broken = False
+            job = interrupted.pop(0)
+            start = time.perf_counter()
+            try:
+                yield executor.submit(run_job, job).result()
+            except BrokenProcessPool:
+                message = f"{job.command}: worker process died\n"
+                yield JobResult(
+                    job.id, job.command, 2, time.perf_counter() - start, message
+                )
+                broken = True
+        if broken:
+            executor.shutdown()
+            executor = concurrent.futures.ProcessPoolExecutor(workers, context)
+
+    try:
+        for n, line in enumerate(manifest, 1):
+            if line.strip() == "":
+                continue
+            try:
+                job = parse_job(n, line)
+            except (TypeError, ValueError) as e:
+                yield JobResult(str(n), "", 1, 0.0, f"invalid job: {e}\n")
+                continue
+            while len(running) >= workers:
+                yield from finish(concurrent.futures.FIRST_COMPLETED)
+            running[executor.submit(run_job, job)] = job
+        while len(running) > 0:
+            yield from finish(concurrent.futures.FIRST_COMPLETED)
+    finally:
+        executor.shutdown()
+
+
+# Write `result' to `report' as a line of JSON.
+def report_result(result: JobResult, report: IO[str]) -> None:
+    fields: Dict[str, Any] = asdict(result)
+    fields["seconds"] = round(result.seconds, 6)
+    print(json.dumps(fields), file=report, flush=True)
@@ -0,0 +1,160 @@
+"""
+PSUtils output cache.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+With --cache-dir, a job's output is kept in the given directory, under a
+hash of its input, the options and default paper size that affect its
+output, and the versions of PSUtils and pypdf. A job whose key is found
+there copies the output instead of writing it. This relies on the output
+being reproducible: PSUtils writes no PDF /ID, and copies the
+%%CreationDate of PostScript input, or takes it from SOURCE_DATE_EPOCH; see
+source_date.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import tempfile
+import time
+from dataclasses import dataclass
+from typing import Callable, IO, List, Optional
+
+import pypdf
+
+from .argparse import VERSION
+from .io import CHUNK_SIZE, MappedFile, copy_file, open_output
+from .libpaper import get_paper_size
+from .stats import current_stats
+from .trace import span
+from .warnings import diagnostics, die, warn
+
+# The environment variable that gives the creation date of the output, as
+# the number of seconds since the Unix epoch, as for reproducible builds
+SOURCE_DATE_VARIABLE = "SOURCE_DATE_EPOCH"
+
+# Options that name files, only change what is reported, or only change how
+# the output is written, so are not part of the key
+UNKEYED_OPTIONS = {
+    "infile",
+    "outfile",
+    "specs_alt",  # pstops's old way to name the output file
+    "append",
+    "verbose",
+    "page_labels",
+    "stats",
+    "cache_dir",
+    "jobs",
+    "pipeline",
+}
+
+
+# Return the creation date given by SOURCE_DATE_EPOCH as a time in UTC, or
+# None if it is not set.
+def source_date() -> Optional[time.struct_time]:
+    value = os.environ.get(SOURCE_DATE_VARIABLE)
+    if value is None or value == "":
+        return None
+    try:
+        return time.gmtime(int(value))
+    except (ValueError, OverflowError, OSError):
+        die(f"{SOURCE_DATE_VARIABLE} `{value}' is not a number of seconds")
+
+
+# Add the contents of `infile' to `digest', leaving it at the start, and
+# return its size. Input that is not mapped is read through, and is kept by
+# its StreamWindow until the job releases it.
+def hash_input(digest: "hashlib._Hash", infile: IO[bytes]) -> int:
+    raw = getattr(infile, "raw", None)
+    size = 0
+    with current_stats().phase("hash"):
+        if isinstance(raw, MappedFile):
+            digest.update(raw.map)
+            size = len(raw.map)
+        else:
+            infile.seek(0)
+            for data in iter(lambda: infile.read(CHUNK_SIZE), b""):
+                digest.update(data)
+                size += len(data)
+        infile.seek(0)
+    return size
+
+
+@dataclass
+class OutputCache:
+    """The output of a job, which is kept in the file `path'."""
+
+    path: str
+    verbose: bool
+
+    # Write the output to the file `outfile_name' with `write', or copy it
+    # from the cache if it is there. A new output is written to the cache
+    # first, and renamed when it is complete, so jobs that run at the same
+    # time do not see each other's partial output.
+    def write_output(
+        self, outfile_name: Optional[str], write: Callable[[IO[bytes]], None]
+    ) -> None:
+        stats = current_stats()
+        if os.path.exists(self.path):
+            stats.took("cache")
+            if self.verbose:
+                diagnostics().write(f"Copying cached output {self.path}\n")
+        else:
+            directory = os.path.dirname(self.path)
+            try:
+                os.makedirs(directory, exist_ok=True)
+                fd, temp_name = tempfile.mkstemp(dir=directory, prefix=".new-")
+            except OSError:
+                die(f"cannot write to cache directory {directory}")
+            try:
+                with os.fdopen(fd, "wb") as temp:
+                    write(temp)
+                os.replace(temp_name, self.path)
+            except BaseException:
+                os.remove(temp_name)
+                raise
+        outfile = open_output(outfile_name)
+        try:
+            with span("copy cached output"):
+                stats.bytes_copied += copy_file(self.path, outfile)
+        finally:
+            outfile.close()
+
+
+# Return the cache for the job given by `args', which reads `inputs' and
+# writes its output with `write', or None if it is not to be cached.
+def job_cache(
+    args: argparse.Namespace, inputs: List[IO[bytes]], write: Callable[..., None]
+) -> Optional[OutputCache]:
+    if args.cache_dir is None:
+        return None
+    if args.split > 0 or len(getattr(args, "fan_out", [])) > 0:
+        warn("the cache is not used with --split or --fan-out")
+        return None
+    options = {
+        name: repr(value)
+        for name, value in sorted(vars(args).items())
+        if name not in UNKEYED_OPTIONS
+    }
+    # Commands with a paper option use the default paper without one
+    default_paper = None
+    if getattr(args, "paper", False) is None:
+        default_paper = repr(get_paper_size())
+    date = source_date()
+    job = [
+        VERSION,
+        pypdf.__version__,
+        f"{write.__module__}.{write.__qualname__}",
+        options,
+        default_paper,
+        None if date is None else list(date),
+    ]
+    digest = hashlib.sha256(json.dumps(job).encode("utf-8"))
+    for infile in inputs:
+        # Follow each input with its size, so that moving bytes from one
+        # input to the next changes the key
+        size = hash_input(digest, infile)
+        digest.update(f"\0{size}".encode("ascii"))
+    key = digest.hexdigest()
+    return OutputCache(os.path.join(args.cache_dir, key[:2], key), args.verbose)
@@ -1,12 +1,11 @@
 import argparse
 import re
 import sys
-import warnings
 from typing import List
 
 from psutils.argparse import HelpFormatter, PaperContext, add_basic_arguments
 from psutils.io import setup_input_and_output
-from psutils.warnings import die, simple_warning
+from psutils.warnings import die
 
 
 def get_parser() -> argparse.ArgumentParser:
@@ -17,7 +16,6 @@ def get_parser() -> argparse.ArgumentParser:
         usage="%(prog)s [OPTION...] LLX LLY URX URY [INFILE [OUTFILE]]",
         add_help=False,
     )
-    warnings.showwarning = simple_warning(parser.prog)
     paper_context = PaperContext()
 
     parser.add_argument(
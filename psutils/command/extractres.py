@@ -2,13 +2,12 @@ import argparse
 import os
 import re
 import sys
-import warnings
 from typing import Dict, List, Optional, IO
 
 from psutils.argparse import HelpFormatter, add_basic_arguments
 from psutils.io import setup_input_and_output
 from psutils.psresources import extn, filename
-from psutils.warnings import die, simple_warning
+from psutils.warnings import die
 
 
 def get_parser() -> argparse.ArgumentParser:
@@ -19,7 +18,6 @@ def get_parser() -> argparse.ArgumentParser:
         usage="%(prog)s [OPTION...] [INFILE [OUTFILE]]",
         add_help=False,
     )
-    warnings.showwarning = simple_warning(parser.prog)
 
     parser.add_argument(
         "-m",
@@ -1,14 +1,12 @@
 import argparse
 import os
 import sys
-import warnings
-from warnings import warn
 from typing import List
 
 from psutils.argparse import HelpFormatter, add_basic_arguments
 from psutils.io import setup_input_and_output
 from psutils.psresources import extn, filename
-from psutils.warnings import die, simple_warning
+from psutils.warnings import die, warn
 
 
 def get_parser() -> argparse.ArgumentParser:
@@ -19,7 +17,6 @@ def get_parser() -> argparse.ArgumentParser:
         usage="%(prog)s [OPTION...] [INFILE [OUTFILE]]",
         add_help=False,
     )
-    warnings.showwarning = simple_warning(parser.prog)
     add_basic_arguments(parser)
 
     return parser
@@ -1,17 +1,26 @@
 import argparse
 import sys
-import warnings
-from typing import List
+from typing import IO, List, Union
 
 from psutils.argparse import (
     HelpFormatter,
     PaperContext,
     add_basic_arguments,
+    add_jobs_argument,
+    add_pipeline_argument,
+    add_split_argument,
+    add_page_labels_argument,
+    add_stats_argument,
+    add_cache_argument,
+    add_incremental_argument,
     parserange,
     parsespecs,
 )
-from psutils.transformers import file_transform
-from psutils.warnings import die, simple_warning
+from psutils.parallel import fan_out
+from psutils.readers import PdfReader, PsReader
+from psutils.transformers import document_transform
+from psutils.types import OutputOptions
+from psutils.warnings import die
 
 
 def get_parser() -> argparse.ArgumentParser:
@@ -26,7 +35,6 @@ PAGES is a comma-separated list of pages and page ranges; see pstops(1)
 for more details.
 """,
     )
-    warnings.showwarning = simple_warning(parser.prog)
 
     # Command-line parser
     parser.add_argument(
@@ -39,61 +47,89 @@ number of pages per signature;
 0 = all pages in one signature [default];
 1 = do not rearrange the pages;
 otherwise, a multiple of 4""",
+    )
+    add_jobs_argument(parser)
+    add_pipeline_argument(parser)
+    add_split_argument(parser)
+    add_page_labels_argument(parser)
+    add_stats_argument(parser)
+    add_cache_argument(parser)
+    add_incremental_argument(parser)
+    parser.add_argument(
+        "--split-signatures",
+        action="store_true",
+        help="""\
+write each signature to a separate document, as
+--split does""",
     )
     add_basic_arguments(parser)
 
     return parser
 
 
-# pylint: disable=dangerous-default-value
-def psbook(argv: List[str] = sys.argv[1:]) -> None:
+def get_args(argv: List[str]) -> argparse.Namespace:
     args = get_parser().parse_intermixed_args(argv)
-
     if args.signature > 1 and args.signature % 4 != 0:
         die("signature must be a multiple of 4")
+    if args.split_signatures:
+        if args.split > 0:
+            die("--split and --split-signatures cannot both be given")
+        # Signature 0 puts all the pages in one signature
+        args.split = args.signature or sys.maxsize
+    return args
+
+
+# Return the pages of a document of `input_pages' pages in signature
+# order, numbered from 1, with 0 for a blank page.
+def book_order(input_pages: int, signature: int) -> List[int]:
+    def page_index_to_real_page(signature: int, page_number: int) -> int:
+        real_page = page_number - page_number % signature
+        page_on_sheet = page_number % 4
+        recto_verso = (page_number % signature) // 2
+        if page_on_sheet in (0, 3):
+            real_page += signature - 1 - recto_verso
+        else:
+            real_page += recto_verso
+        return real_page + 1
+
+    # Adjust for signature size
+    if signature == 0:
+        maxpage = input_pages + (4 - input_pages % 4) % 4
+        signature = maxpage
+    else:
+        maxpage = input_pages + (signature - input_pages % signature) % signature
 
-    # Get number of pages
+    # Compute page list
+    page_list = []
+    for page in range(maxpage):
+        real_page = page_index_to_real_page(signature, page)
+        page_list.append(real_page if real_page <= input_pages else 0)
+    return page_list
+
+
+def bind(
+    doc: Union[PdfReader, PsReader], args: argparse.Namespace, outfile: IO[bytes]
+) -> None:
     paper_context = PaperContext()
     specs, modulo, flipping = parsespecs("0", paper_context)
-    with file_transform(
-        args.infile, args.outfile, None, None, specs, 0, False
-    ) as transform:
-        input_pages = transform.pages()
-
-        def page_index_to_real_page(signature: int, page_number: int) -> int:
-            real_page = page_number - page_number % signature
-            page_on_sheet = page_number % 4
-            recto_verso = (page_number % signature) // 2
-            if page_on_sheet in (0, 3):
-                real_page += signature - 1 - recto_verso
-            else:
-                real_page += recto_verso
-            return real_page + 1
-
-        # Adjust for signature size
-        signature = args.signature
-        if signature == 0:
-            maxpage = input_pages + (4 - input_pages % 4) % 4
-            signature = maxpage
-        else:
-            maxpage = input_pages + (signature - input_pages % signature) % signature
-
-        # Compute page list
-        page_list = []
-        for page in range(maxpage):
-            real_page = page_index_to_real_page(signature, page)
-            page_list.append(str(real_page) if real_page <= input_pages else "_")
-
-        # Rearrange pages
-        transform.transform_pages(
-            parserange(",".join(page_list)),
-            flipping,
-            False,
-            False,
-            False,
-            modulo,
-            args.verbose,
-        )
+    transform = document_transform(doc, outfile, None, None, specs, 0, False)
+    page_list = book_order(transform.pages(), args.signature)
+
+    # Rearrange pages
+    transform.transform_pages(
+        parserange(",".join(str(page) if page > 0 else "_" for page in page_list)),
+        flipping,
+        False,
+        False,
+        False,
+        modulo,
+        OutputOptions.from_args(args),
+    )
+
+
+# pylint: disable=dangerous-default-value
+def psbook(argv: List[str] = sys.argv[1:]) -> None:
+    fan_out(argv, get_args, bind)
 
 
 if __name__ == "__main__":
@@ -2,14 +2,13 @@ import argparse
 import os
 import re
 import sys
-import warnings
 from typing import List
 
 from pypdf import PdfReader, PdfWriter
 import puremagic  # type: ignore
 
 from psutils.argparse import HelpFormatter, add_version_argument
-from psutils.warnings import die, simple_warning
+from psutils.warnings import die
 
 
 def get_parser() -> argparse.ArgumentParser:
@@ -23,7 +22,6 @@ def get_parser() -> argparse.ArgumentParser:
 The --save and --nostrip options only apply to PostScript files.
 """,
     )
-    warnings.showwarning = simple_warning(parser.prog)
 
     # Command-line parser
     parser.add_argument(
@@ -0,0 +1,74 @@
+import argparse
+import sys
+from typing import List
+
+from psutils.argparse import (
+    HelpFormatter,
+    add_append_argument,
+    add_basic_arguments,
+    add_jobs_argument,
+    add_pipeline_argument,
+    add_page_labels_argument,
+    add_stats_argument,
+)
+from psutils.io import setup_inputs, write_output
+from psutils.pipeline import Pipeline
+from psutils.readers import document_reader
+from psutils.stats import report_stats
+from psutils.trace import trace_command
+
+
+def get_parser() -> argparse.ArgumentParser:
+    # Command-line arguments
+    parser = argparse.ArgumentParser(
+        description="Run PSUtils commands on a PDF or PostScript document in one pass.",
+        formatter_class=HelpFormatter,
+        usage="%(prog)s [OPTION...] COMMANDS [INFILE [OUTFILE]]",
+        add_help=False,
+        epilog="""
+COMMANDS is a pipeline of psselect, psbook, pstops and psnup commands
+without file names, written as a single argument, for example:
+
+  pspipe 'psselect 1-16 | psbook -s8 | psnup -2' in.pdf out.pdf
+
+The document is read and written once; no intermediate documents are
+made. Only the last command may be pstops or psnup.
+""",
+    )
+
+    # Command-line parser
+    parser.add_argument(
+        "commands", metavar="COMMANDS", help="the pipeline of commands to run"
+    )
+    add_append_argument(parser)
+    add_jobs_argument(parser)
+    add_pipeline_argument(parser)
+    add_page_labels_argument(parser)
+    add_stats_argument(parser)
+    add_basic_arguments(parser)
+
+    return parser
+
+
+# pylint: disable=dangerous-default-value
+def pspipe(argv: List[str] = sys.argv[1:]) -> None:
+    args = get_parser().parse_intermixed_args(argv)
+    pipeline = Pipeline(args.commands)
+    with trace_command(), report_stats(args.stats):
+        with setup_inputs([args.infile, *args.append]) as inputs:
+            doc = document_reader(*inputs[0], inputs[1:])
+            write_output(
+                args.outfile,
+                lambda outfile: pipeline.run(
+                    doc,
+                    outfile,
+                    args.verbose,
+                    args.jobs,
+                    args.pipeline,
+                    args.page_labels,
+                ),
+            )
+
+
+if __name__ == "__main__":
+    pspipe()
@@ -1,11 +1,16 @@
 import argparse
 import sys
-import warnings
 from typing import List
 
-from psutils.argparse import HelpFormatter, add_basic_arguments
+from psutils.argparse import (
+    HelpFormatter,
+    add_basic_arguments,
+    add_page_labels_argument,
+    add_stats_argument,
+    add_cache_argument,
+    add_incremental_argument,
+)
 from psutils.command.psnup import psnup
-from psutils.warnings import simple_warning
 
 
 def get_parser() -> argparse.ArgumentParser:
@@ -20,7 +25,6 @@ PAGES is a comma-separated list of pages and page ranges; see
 pstops(1) for more details.
     """,
     )
-    warnings.showwarning = simple_warning(parser.prog)
 
     # Command-line parser
     parser.add_argument(
@@ -33,6 +37,10 @@ pstops(1) for more details.
         "--inpaper",
         help="input paper name or dimensions (WIDTHxHEIGHT)",
     )
+    add_page_labels_argument(parser)
+    add_stats_argument(parser)
+    add_cache_argument(parser)
+    add_incremental_argument(parser)
     add_basic_arguments(parser)
 
     # Backwards compatibility
@@ -52,6 +60,8 @@ def psresize(argv: List[str] = sys.argv[1:]) -> None:
     cmd = ["-1"]
     if not args.verbose:
         cmd.append("--quiet")
+    if args.page_labels:
+        cmd.append("--page-labels")
     if args.width:
         cmd.extend(["--width", args.width])
     if args.height:
@@ -64,6 +74,14 @@ def psresize(argv: List[str] = sys.argv[1:]) -> None:
         cmd.extend(["--paper", args.paper])
     if args.inpaper:
         cmd.extend(["--inpaper", args.inpaper])
+    if args.stats == "":
+        cmd.append("--stats")
+    elif args.stats is not None:
+        cmd.extend(["--stats-file", args.stats])
+    if args.cache_dir is not None:
+        cmd.extend(["--cache-dir", args.cache_dir])
+    if args.incremental:
+        cmd.append("--incremental")
     if args.infile is not None:
         cmd.append(args.infile)
     if args.outfile is not None:
@@ -1,17 +1,28 @@
 import argparse
 import sys
-import warnings
-from typing import List
+from typing import IO, List, Union
 
 from psutils.argparse import (
     HelpFormatter,
     PaperContext,
     add_basic_arguments,
+    add_append_argument,
+    add_fan_out_argument,
+    add_jobs_argument,
+    add_pipeline_argument,
+    add_split_argument,
+    add_page_labels_argument,
+    add_stats_argument,
+    add_cache_argument,
+    add_incremental_argument,
     parserange,
     parsespecs,
 )
-from psutils.transformers import file_transform
-from psutils.warnings import die, simple_warning
+from psutils.parallel import fan_out
+from psutils.readers import PdfReader, PsReader
+from psutils.transformers import document_transform
+from psutils.types import OutputOptions
+from psutils.warnings import die
 
 
 def get_parser() -> argparse.ArgumentParser:
@@ -26,7 +37,6 @@ PAGES is a comma-separated list of pages and page ranges; see
 pstops(1) for more details.
 """,
     )
-    warnings.showwarning = simple_warning(parser.prog)
 
     # Command-line parser
     parser.add_argument("-R", "-p", "--pages", help="select the given page ranges")
@@ -42,14 +52,29 @@ pstops(1) for more details.
         action="store_true",
         help="reverse the order of the output pages",
     )
+    parser.add_argument(
+        "--prune-resources",
+        action="store_true",
+        help="""\
+omit fonts supplied by a PostScript document that
+no selected page uses (needs %%%%PageResources)""",
+    )
+    add_jobs_argument(parser)
+    add_pipeline_argument(parser)
+    add_split_argument(parser)
+    add_page_labels_argument(parser)
+    add_stats_argument(parser)
+    add_cache_argument(parser)
+    add_incremental_argument(parser)
+    add_append_argument(parser)
+    add_fan_out_argument(parser)
     parser.add_argument("alt_pages", metavar="PAGES", nargs="?", help=argparse.SUPPRESS)
     add_basic_arguments(parser)
 
     return parser
 
 
-# pylint: disable=dangerous-default-value
-def psselect(argv: List[str] = sys.argv[1:]) -> None:
+def get_args(argv: List[str]) -> argparse.Namespace:
     args = get_parser().parse_intermixed_args(argv)
 
     # Get page range argument if supplied as a non-option
@@ -69,17 +94,40 @@ def psselect(argv: List[str] = sys.argv[1:]) -> None:
                     die("--pages must be used when --even, --odd or --reverse is used")
             args.outfile = args.infile
             args.infile = args.alt_pages
+    return args
+
 
+def select(
+    doc: Union[PdfReader, PsReader], args: argparse.Namespace, outfile: IO[bytes]
+) -> None:
     # Rearrange pages
     pagerange = parserange(args.pages) if args.pages is not None else None
     paper_context = PaperContext()
     specs, modulo, flipping = parsespecs("0", paper_context)
-    with file_transform(
-        args.infile, args.outfile, None, None, specs, 0, False
-    ) as transform:
-        transform.transform_pages(
-            pagerange, flipping, args.reverse, args.odd, args.even, modulo, args.verbose
-        )
+    transform = document_transform(
+        doc,
+        outfile,
+        None,
+        None,
+        specs,
+        0,
+        False,
+        prune_resources=args.prune_resources,
+    )
+    transform.transform_pages(
+        pagerange,
+        flipping,
+        args.reverse,
+        args.odd,
+        args.even,
+        modulo,
+        OutputOptions.from_args(args),
+    )
+
+
+# pylint: disable=dangerous-default-value
+def psselect(argv: List[str] = sys.argv[1:]) -> None:
+    fan_out(argv, get_args, select)
 
 
 if __name__ == "__main__":
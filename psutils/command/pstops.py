@@ -1,7 +1,6 @@
 import argparse
 import sys
-import warnings
-from typing import List, Optional, Tuple, NoReturn
+from typing import IO, List, Optional, Tuple, NoReturn, Union
 
 from psutils.argparse import (
     HelpFormatter,
@@ -11,12 +10,23 @@ from psutils.argparse import (
     add_file_arguments,
     add_paper_arguments,
     add_draw_argument,
+    add_procset_argument,
+    add_jobs_argument,
+    add_pipeline_argument,
+    add_split_argument,
+    add_page_labels_argument,
+    add_stats_argument,
+    add_cache_argument,
+    add_incremental_argument,
+    add_append_argument,
+    add_fan_out_argument,
     parserange,
     parsespecs,
 )
-from psutils.transformers import file_transform
-from psutils.types import Rectangle
-from psutils.warnings import simple_warning
+from psutils.parallel import fan_out
+from psutils.readers import PdfReader, PsReader
+from psutils.transformers import document_transform
+from psutils.types import OutputOptions, Range, Rectangle
 
 
 DEFAULT_SPECS = "0"
@@ -37,7 +47,6 @@ SPECS is a list of page specifications [default is "{DEFAULT_SPECS}", which sele
 each page in its normal order].
 """,
     )
-    warnings.showwarning = simple_warning(parser.prog)
     paper_context = PaperContext()
 
     # Command-line parser
@@ -73,6 +82,16 @@ each page in its normal order].
     )
     add_paper_arguments(parser)
     add_draw_argument(parser, paper_context)
+    add_procset_argument(parser)
+    add_jobs_argument(parser)
+    add_pipeline_argument(parser)
+    add_split_argument(parser)
+    add_page_labels_argument(parser)
+    add_stats_argument(parser)
+    add_cache_argument(parser)
+    add_incremental_argument(parser)
+    add_append_argument(parser)
+    add_fan_out_argument(parser)
     parser.add_argument("-b", "--nobind", help=argparse.SUPPRESS)
     add_version_argument(parser)
     add_quiet_and_help_arguments(parser)
@@ -95,8 +114,7 @@ def spec_exception() -> NoReturn:
     raise SpecsException("invalid specs")
 
 
-# pylint: disable=dangerous-default-value
-def pstops(argv: List[str] = sys.argv[1:]) -> None:
+def get_args(argv: List[str]) -> argparse.Namespace:
     parser, paper_context = get_parser()
     args = parser.parse_intermixed_args(argv)
 
@@ -112,7 +130,17 @@ def pstops(argv: List[str] = sys.argv[1:]) -> None:
             args.outfile = args.specs_alt
         except SpecsException:
             args.specs = DEFAULT_SPECS
+    return args
+
 
+# If `pagerange' is given, it replaces the page selection given by `args'.
+def rearrange(
+    doc: Union[PdfReader, PsReader],
+    args: argparse.Namespace,
+    outfile: IO[bytes],
+    pagerange: Optional[List[Range]] = None,
+) -> None:
+    paper_context = PaperContext()
     size: Optional[Rectangle] = None
     in_size: Optional[Rectangle] = None
     if args.paper:
@@ -127,24 +155,35 @@ def pstops(argv: List[str] = sys.argv[1:]) -> None:
         paper_context = PaperContext(size)
     specs, modulo, flipping = parsespecs(args.specs, paper_context)
 
-    with file_transform(
-        args.infile,
-        args.outfile,
+    transform = document_transform(
+        doc,
+        outfile,
         size,
         in_size,
         specs,
         args.draw,
         False,
-    ) as transform:
-        transform.transform_pages(
-            args.pagerange,
-            flipping,
-            args.reverse,
-            args.odd,
-            args.even,
-            modulo,
-            args.verbose,
-        )
+        args.light_procset,
+    )
+    reverse, odd, even = args.reverse, args.odd, args.even
+    if pagerange is None:
+        pagerange = args.pagerange
+    else:
+        reverse, odd, even = False, False, False
+    transform.transform_pages(
+        pagerange,
+        flipping,
+        reverse,
+        odd,
+        even,
+        modulo,
+        OutputOptions.from_args(args),
+    )
+
+
+# pylint: disable=dangerous-default-value
+def pstops(argv: List[str] = sys.argv[1:]) -> None:
+    fan_out(argv, get_args, rearrange)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,153 @@
+import argparse
+import sys
+from contextlib import ExitStack
+from typing import List
+
+from psutils.argparse import (
+    HelpFormatter,
+    add_version_argument,
+    byte_size,
+    connections,
+    jobs,
+)
+from psutils.batch import COMMANDS, report_result, run_batch
+from psutils.server import MAX_CONNECTIONS, MAX_INPUT_SIZE, serve
+from psutils.warnings import die
+
+
+def get_parser() -> argparse.ArgumentParser:
+    # Command-line arguments
+    parser = argparse.ArgumentParser(
+        description="Run PSUtils commands in one process.",
+        formatter_class=HelpFormatter,
+        usage="%(prog)s [OPTION...] COMMAND ...",
+        add_help=False,
+    )
+
+    # Command-line parser
+    parser.add_argument("--help", action="help", help="show this help message and exit")
+    add_version_argument(parser)
+    subparsers = parser.add_subparsers(dest="command", metavar="COMMAND", required=True)
+
+    batch_parser = subparsers.add_parser(
+        "batch",
+        prog=f"{parser.prog} batch",
+        description="Run a batch of jobs.",
+        help="run a batch of jobs",
+        formatter_class=HelpFormatter,
+        usage="%(prog)s [OPTION...] [MANIFEST]",
+        add_help=False,
+        epilog=f"""
+Each line of MANIFEST is a JSON object describing a job, for example:
+
+  {{"command": "psnup", "args": ["-2"], "input": "in.ps", "output": "out.ps"}}
+
+and optionally an "id" to report it by [default: its line number]. The
+output cannot be "-", as the report goes to standard output. The command
+may be any of:
+
+  {", ".join(COMMANDS)}
+
+A line of JSON is written to standard output for each job as it finishes,
+giving its id, command, exit status (0 for success), time taken in
+seconds, and the messages it wrote. A job whose process dies fails with
+status 2, and the other jobs carry on. The exit status is 1 if any job
+failed.
+""",
+    )
+    batch_parser.add_argument(
+        "-j",
+        "--jobs",
+        metavar="NUMBER",
+        type=jobs,
+        help="number of jobs to run at once [default: number of processors]",
+    )
+    batch_parser.add_argument(
+        "--help", action="help", help="show this help message and exit"
+    )
+    batch_parser.add_argument(
+        "manifest",
+        metavar="MANIFEST",
+        nargs="?",
+        help="`-' or no MANIFEST argument means standard input",
+    )
+
+    serve_parser = subparsers.add_parser(
+        "serve",
+        prog=f"{parser.prog} serve",
+        description="Run jobs sent to a Unix domain socket.",
+        help="run jobs sent to a socket",
+        formatter_class=HelpFormatter,
+        usage="%(prog)s [OPTION...] SOCKET",
+        add_help=False,
+        epilog="""
+Each connection to SOCKET carries one job, sent as a line of JSON in the
+form used by `psutils batch'. A job may omit its input and instead give an
+"input_size", followed by that many bytes of input. The server replies
+with a line of JSON giving the job's result; if the job omitted its
+output, the reply has an "output_size", followed by that many bytes of
+output. File names are relative to the server's working directory.
+
+Connections beyond the number handled at once wait to be accepted. The
+server runs until it receives SIGINT or SIGTERM, when it stops accepting
+jobs, finishes those it has, and exits.
+""",
+    )
+    serve_parser.add_argument(
+        "-j",
+        "--jobs",
+        metavar="NUMBER",
+        type=jobs,
+        help="number of jobs to run at once [default: number of processors]",
+    )
+    serve_parser.add_argument(
+        "--max-connections",
+        metavar="NUMBER",
+        type=connections,
+        default=MAX_CONNECTIONS,
+        help=f"number of connections to handle at once [default {MAX_CONNECTIONS}]",
+    )
+    serve_parser.add_argument(
+        "--max-input-size",
+        metavar="BYTES",
+        type=byte_size,
+        default=MAX_INPUT_SIZE,
+        help=f"largest input to accept with a job [default {MAX_INPUT_SIZE}]",
+    )
+    serve_parser.add_argument(
+        "--help", action="help", help="show this help message and exit"
+    )
+    serve_parser.add_argument(
+        "socket", metavar="SOCKET", help="the socket on which to listen"
+    )
+
+    return parser
+
+
+def batch(args: argparse.Namespace) -> None:
+    with ExitStack() as stack:
+        manifest = sys.stdin
+        if args.manifest is not None and args.manifest != "-":
+            try:
+                manifest = stack.enter_context(open(args.manifest, encoding="utf-8"))
+            except IOError:
+                die(f"cannot open manifest {args.manifest}")
+        failed = False
+        for result in run_batch(manifest, args.jobs):
+            report_result(result, sys.stdout)
+            failed = failed or result.status != 0
+    if failed:
+        sys.exit(1)
+
+
+# pylint: disable=dangerous-default-value
+def psutils(argv: List[str] = sys.argv[1:]) -> None:
+    args = get_parser().parse_args(argv)
+    if args.command == "batch":
+        batch(args)
+    elif args.command == "serve":
+        serve(args.socket, args.jobs, args.max_connections, args.max_input_size)
+
+
+if __name__ == "__main__":
+    psutils()
@@ -0,0 +1,252 @@
+"""
+PSUtils incremental output.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+With --incremental, the output file is written with an index beside it,
+named by adding INDEX_SUFFIX, that records a hash of each input page and
+of each sheet: the options of the job, the sheet's place in the output,
+and the hashes of the pages on it. When the job is run again, a sheet whose
+hash is in the index of the previous output is copied from it, rather than
+built again: PostScript sheets as bytes, and PDF sheets as page objects
+grafted into the new document.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+from contextlib import ExitStack
+from contextvars import ContextVar
+from typing import TYPE_CHECKING, Any, Callable, Dict, IO, List, Optional, Set, Tuple
+
+from pypdf import PdfReader
+from pypdf.generic import (
+    ArrayObject,
+    DictionaryObject,
+    IndirectObject,
+    PdfObject,
+    StreamObject,
+)
+
+from .argparse import VERSION
+from .trace import span
+from .types import Plan
+from .warnings import die, warn
+
+if TYPE_CHECKING:
+    from .transformers import DocumentTransform
+
+INDEX_SUFFIX = ".psutils-sheets"
+
+
+class Incremental:
+    """The sheets of the previous version of the output file `outfile_name',
+    and those of the version being written."""
+
+    def __init__(self, outfile_name: str) -> None:
+        self.outfile_name = outfile_name
+        # The sheets of the previous output, by hash
+        self.previous: Dict[str, Dict[str, Any]] = {}
+        self.previous_file: Optional[IO[bytes]] = None
+        self.previous_pdf: Optional[PdfReader] = None
+        # Closes the previous output
+        self.resources = ExitStack()
+        # The index of the new output
+        self.pages: Dict[int, str] = {}
+        self.sheets: List[Dict[str, Any]] = []
+        try:
+            with open(self.index_name, encoding="utf-8") as h:
+                index = json.load(h)
+            # The output must not have been written since the index was
+            output = os.stat(outfile_name)
+            if index.get("version") == VERSION and index.get("output") == [
+                output.st_size,
+                output.st_mtime_ns,
+            ]:
+                for n, sheet in enumerate(index["sheets"]):
+                    self.previous.setdefault(sheet["key"], {"page": n, **sheet})
+        except (OSError, ValueError, KeyError, TypeError):
+            pass
+
+    @property
+    def index_name(self) -> str:
+        return self.outfile_name + INDEX_SUFFIX
+
+    # Return the sheet of the previous output with hash `key', if any.
+    def find(self, key: str) -> Optional[Dict[str, Any]]:
+        return self.previous.get(key)
+
+    # Return the previous output, opened for reading.
+    def previous_output(self) -> IO[bytes]:
+        if self.previous_file is None:
+            self.previous_file = self.resources.enter_context(
+                open(self.outfile_name, "rb")
+            )
+        return self.previous_file
+
+    # Return the previous output, read as a PDF document.
+    def previous_document(self) -> PdfReader:
+        if self.previous_pdf is None:
+            self.previous_pdf = PdfReader(self.outfile_name)
+        return self.previous_pdf
+
+    # Record the next sheet of the new output, with hash `key', made from
+    # the input pages `pages', and, for PostScript, found at bytes `start' to
+    # `stop'.
+    def add(self, key: str, pages: List[int], start: int = 0, stop: int = 0) -> None:
+        sheet: Dict[str, Any] = {"key": key, "pages": pages}
+        if stop > start:
+            sheet["start"], sheet["stop"] = start, stop
+        self.sheets.append(sheet)
+
+    def close(self) -> None:
+        self.resources.close()
+
+    # Write the index of the new output, which is the file `name', to the
+    # file `index_name'.
+    def save(self, name: str, index_name: str) -> None:
+        output = os.stat(name)
+        index = {
+            "version": VERSION,
+            "output": [output.st_size, output.st_mtime_ns],
+            "pages": [
+                self.pages.get(n) for n in range(max(self.pages, default=-1) + 1)
+            ],
+            "sheets": self.sheets,
+        }
+        with open(index_name, "w", encoding="utf-8") as h:
+            json.dump(index, h)
+            h.write("\n")
+
+
+# The sheets being reused in the current context
+_incremental: ContextVar[Optional[Incremental]] = ContextVar(
+    "incremental", default=None
+)
+
+
+# Return the sheets being reused in the current context, if any.
+def current_incremental() -> Optional[Incremental]:
+    return _incremental.get()
+
+
+# Return whether the job given by `args' reuses the sheets of its previous
+# output, checking that it can.
+def incremental_job(args: argparse.Namespace) -> bool:
+    if not args.incremental:
+        return False
+    if args.split > 0 or len(getattr(args, "fan_out", [])) > 0:
+        die("--incremental cannot be used with --split or --fan-out")
+    if args.cache_dir is not None:
+        die("--incremental and --cache-dir cannot both be given")
+    if getattr(args, "jobs", 1) > 1 or getattr(args, "pipeline", False):
+        warn("--jobs and --pipeline are not used with --incremental")
+    return True
+
+
+# Write the output file `outfile_name' with `write', reusing the sheets of
+# its previous version. The new output and its index are written to
+# temporary files, and renamed over the old ones when they are complete.
+def write_incremental(
+    outfile_name: Optional[str], write: Callable[[IO[bytes]], None]
+) -> None:
+    if outfile_name is None or outfile_name == "-":
+        die("an output file name is needed with --incremental")
+    incremental = Incremental(outfile_name)
+    name = f"{outfile_name}.new-{os.getpid()}"
+    index_name = f"{incremental.index_name}.new-{os.getpid()}"
+    try:
+        token = _incremental.set(incremental)
+        try:
+            outfile = open(name, "wb")
+        except IOError:
+            die(f"cannot open output file {name}")
+        try:
+            with outfile:
+                write(outfile)
+        finally:
+            _incremental.reset(token)
+            incremental.close()
+        incremental.save(name, index_name)
+        os.replace(name, outfile_name)
+        os.replace(index_name, incremental.index_name)
+    except BaseException:
+        for temp in (name, index_name):
+            if os.path.exists(temp):
+                os.remove(temp)
+        raise
+
+
+# Write the sheets of `transform', copying each that is in the previous
+# output from there, and record them in the index of the new output.
+def write_sheets_incremental(
+    transform: "DocumentTransform", plan: Plan, incremental: Incremental
+) -> None:
+    context = transform.sheet_context()
+    reused = 0
+    for sheet in plan.sheets:
+        transform.progress.sheet(sheet.pagelabel)
+        sources = transform.sheet_sources(plan, sheet)
+        digests = []
+        for page in sources:
+            if page is not None and page not in incremental.pages:
+                with span("hash page", page=page + 1):
+                    incremental.pages[page] = transform.page_digest(page)
+            digests.append(None if page is None else incremental.pages[page])
+        job = [context, sheet.outputpage, sheet.pagelabel, digests]
+        key = hashlib.sha256(json.dumps(job).encode("utf-8")).hexdigest()
+        start = transform.outfile.tell()
+        previous = incremental.find(key)
+        if previous is not None:
+            with span("reuse sheet", page=sheet.pagelabel, sheet=sheet.outputpage):
+                transform.reuse_sheet(incremental, previous)
+            reused += 1
+        else:
+            transform.write_sheet(plan, sheet)
+        pages = [page for page in sources if page is not None]
+        incremental.add(key, pages, start, transform.outfile.tell())
+    transform.stats.sheets_reused = reused
+
+
+# Add a serialization of the PDF object `obj' to `digest', following
+# indirect references, but not the /Parent of a page. The hash of each
+# indirect object is kept in `memo', so that objects shared between pages,
+# such as fonts, are only read once; `active' holds those being hashed, to
+# break cycles. Objects are known by their document and number.
+def hash_pdf_object(
+    digest: "hashlib._Hash",
+    obj: PdfObject,
+    memo: Dict[Tuple[int, int], bytes],
+    active: Set[Tuple[int, int]],
+) -> None:
+    if isinstance(obj, IndirectObject):
+        ref = (id(obj.pdf), obj.idnum)
+        if ref in active:
+            digest.update(b"cycle")
+            return
+        if ref not in memo:
+            active.add(ref)
+            inner = hashlib.sha256()
+            target = obj.get_object()
+            if target is not None:
+                hash_pdf_object(inner, target, memo, active)
+            active.remove(ref)
+            memo[ref] = inner.digest()
+        digest.update(b"R" + memo[ref])
+    elif isinstance(obj, DictionaryObject):
+        digest.update(b"<<")
+        for key in sorted(obj.keys()):
+            if key != "/Parent":
+                digest.update(key.encode("utf-8"))
+                hash_pdf_object(digest, obj.raw_get(key), memo, active)
+        digest.update(b">>")
+        if isinstance(obj, StreamObject):
+            digest.update(obj.get_data())
+    elif isinstance(obj, ArrayObject):
+        digest.update(b"[")
+        for item in obj:
+            hash_pdf_object(digest, item, memo, active)
+        digest.update(b"]")
+    else:
+        digest.update(repr(obj).encode("utf-8") + b" ")
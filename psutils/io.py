@@ -4,50 +4,500 @@ Copyright (c) Reuben Thomas 2023.
 Released under the GPL version 3, or (at your option) any later version.
 """
 
+import bisect
 import io
+import mmap
 import os
+import shutil
+import stat
 import sys
-from contextlib import contextmanager
-from typing import Tuple, Optional, Iterator, IO
+from contextlib import ExitStack, contextmanager
+from typing import (
+    Any,
+    Callable,
+    Dict,
+    List,
+    Tuple,
+    Optional,
+    Iterator,
+    IO,
+    Sequence,
+    Union,
+    cast,
+)
 
 import puremagic  # type: ignore
 
+from .stats import current_stats
 from .warnings import die
 
+# Linux's ioctl that makes a file share the data of another, or reflink
+FICLONE = 0x40049409
+
+# How much StreamWindow reads from its stream at a time
+CHUNK_SIZE = 65536
+
+# How much ReadAhead asks for at a time, and the largest gap between two
+# ranges that it fills in to ask for them together
+READ_AHEAD = 4 * 1024 * 1024
+COALESCE_GAP = 64 * 1024
+
+
+class MappedFile(io.RawIOBase):
+    """A read-only memory map of a whole file."""
+
+    def __init__(self, fileno: int) -> None:
+        super().__init__()
+        self.map = mmap.mmap(fileno, 0, access=mmap.ACCESS_READ)
+        # Keep a descriptor for posix_fadvise
+        self.fd = os.dup(fileno)
+
+    def readable(self) -> bool:
+        return True
+
+    def seekable(self) -> bool:
+        return True
+
+    def readinto(self, buffer: Any) -> int:
+        data = self.map.read(len(buffer))
+        buffer[: len(data)] = data
+        current_stats().bytes_read += len(data)
+        return len(data)
+
+    def seek(self, offset: int, whence: int = os.SEEK_SET) -> int:
+        if whence == os.SEEK_CUR:
+            offset += self.map.tell()
+        elif whence == os.SEEK_END:
+            offset += len(self.map)
+        self.map.seek(offset)
+        return self.map.tell()
+
+    def tell(self) -> int:
+        return self.map.tell()
+
+    # Return bytes `start' to `stop' without moving the file position. They
+    # are read from the descriptor rather than the map, as a read releases
+    # the GIL while it waits for the disk, but a page fault does not.
+    def pread(self, start: int, stop: int) -> bytes:
+        data = os.pread(self.fd, stop - start, start)
+        current_stats().bytes_read += len(data)
+        return data
+
+    # Tell the kernel whether bytes `start' to `stop' will be needed soon;
+    # ignored where not supported.
+    def advise(self, start: int, stop: int, needed: bool) -> None:
+        page = mmap.PAGESIZE
+        if needed:
+            start -= start % page
+        else:
+            # Only drop pages that lie wholly inside the range
+            start += -start % page
+            stop -= stop % page
+        if stop <= start:
+            return
+        try:
+            if needed:
+                self.map.madvise(mmap.MADV_WILLNEED, start, stop - start)
+            else:
+                # Unmap the pages, so that they can be dropped from the cache
+                self.map.madvise(mmap.MADV_DONTNEED, start, stop - start)
+                os.posix_fadvise(self.fd, start, stop - start, os.POSIX_FADV_DONTNEED)
+        except (AttributeError, OSError, ValueError):
+            pass
+
+    def close(self) -> None:
+        if not self.closed:
+            self.map.close()
+            os.close(self.fd)
+        super().close()
+
+
+class MemoryFile(io.RawIOBase):
+    """A read-only file over a buffer, such as bytes or an mmap, which is
+    not copied."""
+
+    def __init__(self, buffer: Any) -> None:
+        super().__init__()
+        self.buffer = memoryview(buffer).cast("B")
+        self.pos = 0
+
+    def readable(self) -> bool:
+        return True
+
+    def seekable(self) -> bool:
+        return True
+
+    def readinto(self, buffer: Any) -> int:
+        data = self.buffer[self.pos : self.pos + len(buffer)]
+        buffer[: len(data)] = data
+        self.pos += len(data)
+        current_stats().bytes_read += len(data)
+        return len(data)
+
+    def seek(self, offset: int, whence: int = os.SEEK_SET) -> int:
+        if whence == os.SEEK_CUR:
+            offset += self.pos
+        elif whence == os.SEEK_END:
+            offset += len(self.buffer)
+        self.pos = max(offset, 0)
+        return self.pos
+
+    def tell(self) -> int:
+        return self.pos
+
+    def close(self) -> None:
+        if not self.closed:
+            self.buffer.release()
+        super().close()
+
+
+class ReadAhead:  # pylint: disable=too-many-instance-attributes
+    """Advise the kernel about reads from a MappedFile in a known order.
+
+    Ranges a little ahead of the reader are asked for, merging nearby ones,
+    and ranges that will not be read again are dropped once the reader has
+    passed them, unless `drop' is False, as when other processes read the
+    file at the same time.
+    """
+
+    def __init__(
+        self, mapped: MappedFile, ranges: List[range], drop: bool = True
+    ) -> None:
+        self.mapped = mapped
+        self.ranges = ranges
+        self.drop = drop
+        # Where each range is read, by the offset of its start
+        self.positions: Dict[int, List[int]] = {}
+        for i, r in enumerate(ranges):
+            self.positions.setdefault(r.start, []).append(i)
+        self.cursor = 0  # the range being read
+        self.advised = 0  # ranges before this have been asked for
+        self.next_batch = 0  # when to ask for more
+        self.passed = 0  # ranges before this have been dropped if unneeded
+
+    # Note that the range starting at `start' is about to be read.
+    def reading(self, start: int) -> None:
+        positions = self.positions.get(start, [])
+        i = bisect.bisect_left(positions, self.cursor)
+        if i == len(positions):
+            return
+        self.cursor = positions[i]
+        if self.cursor < self.next_batch:
+            return
+
+        # When half way through the last batch, drop ranges behind the
+        # cursor that are not read again, and ask for the next batch
+        done = []
+        while self.passed < self.cursor:
+            r = self.ranges[self.passed]
+            if self.positions[r.start][-1] < self.cursor:
+                done.append(r)
+            self.passed += 1
+        if self.drop:
+            self.advise(done, False)
+        first = last = max(self.advised, self.cursor)
+        size = 0
+        while last < len(self.ranges) and size < READ_AHEAD:
+            size += len(self.ranges[last])
+            last += 1
+        self.advise(self.ranges[first:last], True)
+        self.advised = last
+        self.next_batch = (first + last + 1) // 2
+
+    # Advise about `ranges', merging those that touch, or, if they are
+    # needed, that are close.
+    def advise(self, ranges: List[range], needed: bool) -> None:
+        gap = COALESCE_GAP if needed else 0
+        merged: List[range] = []
+        for r in sorted(ranges, key=lambda r: r.start):
+            if len(merged) > 0 and r.start - merged[-1].stop <= gap:
+                merged[-1] = range(merged[-1].start, max(merged[-1].stop, r.stop))
+            else:
+                merged.append(r)
+        for r in merged:
+            self.mapped.advise(r.start, r.stop, needed)
+
+
+class StreamWindow(io.BufferedIOBase):
+    """A seekable view of a stream that can only be read forwards.
+
+    Data read from the stream is kept until it is released, so callers may
+    seek anywhere after the last released offset.
+    """
+
+    def __init__(self, stream: IO[bytes]) -> None:
+        super().__init__()
+        self.stream = stream
+        self.window = bytearray()
+        self.base = 0  # stream offset of window[0]
+        self.pos = 0
+        self.eof = False
+
+    def readable(self) -> bool:
+        return True
+
+    def seekable(self) -> bool:
+        return True
+
+    # Read from the stream until the window reaches offset `end', or the end
+    # of the stream if `end' is None.
+    def fill(self, end: Optional[int]) -> None:
+        while not self.eof and (end is None or self.base + len(self.window) < end):
+            data = self.stream.read1(CHUNK_SIZE)  # type: ignore
+            if len(data) == 0:
+                self.eof = True
+            self.window += data
+            current_stats().bytes_read += len(data)
+
+    # Discard data before `offset'.
+    def release(self, offset: int) -> None:
+        n = min(offset - self.base, len(self.window))
+        if n > 0:
+            del self.window[:n]
+            self.base += n
+
+    def start(self) -> int:
+        if self.pos < self.base:
+            raise OSError("cannot read data that has been released")
+        return self.pos - self.base
+
+    def read(self, size: Optional[int] = -1) -> bytes:
+        start = self.start()
+        if size is None or size < 0:
+            self.fill(None)
+            end = len(self.window)
+        else:
+            self.fill(self.pos + size)
+            end = min(start + size, len(self.window))
+        data = bytes(self.window[start:end])
+        self.pos += len(data)
+        return data
+
+    def read1(self, size: int = -1) -> bytes:
+        return self.read(size)
+
+    def peek(self, size: int = 0) -> bytes:
+        start = self.start()
+        self.fill(self.pos + max(size, 1))
+        return bytes(self.window[start:])
+
+    def readline(self, size: Optional[int] = -1) -> bytes:
+        start = self.start()
+        searched = start
+        while True:
+            end = self.window.find(b"\n", searched) + 1
+            if end > 0 or self.eof:
+                break
+            searched = len(self.window)
+            self.fill(self.base + searched + 1)
+        if end == 0:
+            end = len(self.window)
+        if size is not None and size >= 0:
+            end = min(end, start + size)
+        data = bytes(self.window[start:end])
+        self.pos += len(data)
+        return data
+
+    def seek(self, offset: int, whence: int = os.SEEK_SET) -> int:
+        if whence == os.SEEK_CUR:
+            offset += self.pos
+        elif whence == os.SEEK_END:
+            self.fill(None)
+            offset += self.base + len(self.window)
+        if offset < self.base:
+            raise OSError("cannot seek to data that has been released")
+        self.pos = offset
+        return self.pos
+
+    def tell(self) -> int:
+        return self.pos
+
+    def close(self) -> None:
+        if not self.closed:
+            self.stream.close()
+        super().close()
+
+
+# Return the file type of a file starting with `head', or "" if it is not
+# known.
+def file_type_of(head: bytes) -> str:
+    try:
+        return str(puremagic.from_string(head[:16]))
+    except (LookupError, ValueError):  # puremagic.PureError, or empty input
+        return ""
+
 
 @contextmanager
-def setup_input_and_output(
-    infile_name: Optional[str], outfile_name: Optional[str]
-) -> Iterator[Tuple[IO[bytes], str, IO[bytes]]]:
-    # Set up input
-    infile: Optional[IO[bytes]] = None
-    if infile_name is not None:
+def setup_input(infile_name: Optional[str]) -> Iterator[Tuple[IO[bytes], str]]:
+    stats = current_stats()
+    with stats.phase("open"):
+        infile: Optional[IO[bytes]] = None
+        if infile_name is not None and infile_name != "-":
+            try:
+                infile = open(infile_name, "rb")
+            except IOError:
+                die(f"cannot open input file {infile_name}")
+        else:
+            infile = os.fdopen(sys.stdin.fileno(), "rb", closefd=False)
+
+        # Map a regular file, so that it is shared with worker processes rather
+        # than copied; read anything else through a StreamWindow, which keeps
+        # only what has not been released
+        mapped: Optional[MappedFile] = None
+        if stat.S_ISREG(os.fstat(infile.fileno()).st_mode):
+            try:
+                mapped = MappedFile(infile.fileno())
+                stats.took("mmap")
+            except (ValueError, OSError):
+                pass
+
+        # Find MIME type of input
+        if mapped is not None:
+            infile.close()
+            buffered = io.BufferedReader(mapped)
+            file_type = file_type_of(buffered.peek(16))
+            infile = buffered
+        else:
+            window = StreamWindow(infile)
+            file_type = file_type_of(window.peek(16))
+            infile = cast(IO[bytes], window)
+
+    try:
+        yield infile, file_type
+    finally:
+        infile.close()
+
+
+# Open each of `infile_names' as setup_input does.
+@contextmanager
+def setup_inputs(
+    infile_names: Sequence[Optional[str]],
+) -> Iterator[List[Tuple[IO[bytes], str]]]:
+    with ExitStack() as stack:
+        yield [stack.enter_context(setup_input(name)) for name in infile_names]
+
+
+# A document to read: a file name, the contents of a file, such as bytes or
+# an mmap, or a binary file object
+Source = Union[
+    str, "os.PathLike[str]", bytes, bytearray, memoryview, mmap.mmap, IO[bytes]
+]
+
+
+# Open `source' as setup_input does. A file object is read from its current
+# position, and is not closed.
+@contextmanager
+def setup_source(source: Source) -> Iterator[Tuple[IO[bytes], str]]:
+    if isinstance(source, (str, os.PathLike)):
+        with setup_input(os.fspath(source)) as (infile, file_type):
+            yield infile, file_type
+        return
+    if isinstance(source, (bytes, bytearray, memoryview, mmap.mmap)):
+        infile = io.BufferedReader(MemoryFile(source))
         try:
-            infile = open(infile_name, "rb")
-        except IOError:
-            die(f"cannot open input file {infile_name}")
+            yield infile, file_type_of(infile.peek(16))
+        finally:
+            infile.close()
+        return
+    if source.seekable():
+        pos = source.tell()
+        head = source.read(16)
+        source.seek(pos)
+        yield source, file_type_of(head)
     else:
-        infile = os.fdopen(sys.stdin.fileno(), "rb", closefd=False)
-
-    # Find MIME type of input
-    data = infile.read(16)
-    file_type = puremagic.from_string(data)
+        window = StreamWindow(source)
+        yield cast(IO[bytes], window), file_type_of(window.peek(16))
 
-    # Slurp infile into a seekable BytesIO
-    infile = io.BytesIO(data + infile.read())
 
-    # Set up output
-    if outfile_name is not None:
+def open_output(outfile_name: Optional[str]) -> IO[bytes]:
+    if outfile_name is not None and outfile_name != "-":
         try:
-            outfile = open(outfile_name, "wb")
+            return open(outfile_name, "wb")
         except IOError:
             die(f"cannot open output file {outfile_name}")
-    else:
-        outfile = os.fdopen(sys.stdout.fileno(), "wb", closefd=False)
+    return os.fdopen(sys.stdout.fileno(), "wb", closefd=False)
 
-    # Context manager
+
+def write_output(
+    outfile_name: Optional[str], write: Callable[[IO[bytes]], None]
+) -> None:
+    outfile = open_output(outfile_name)
     try:
-        yield infile, file_type, outfile
+        write(outfile)
     finally:
-        infile.close()
         outfile.close()
+
+
+@contextmanager
+def setup_input_and_output(
+    infile_name: Optional[str], outfile_name: Optional[str]
+) -> Iterator[Tuple[IO[bytes], str, IO[bytes]]]:
+    with setup_input(infile_name) as (infile, file_type):
+        outfile = open_output(outfile_name)
+        try:
+            yield infile, file_type, outfile
+        finally:
+            outfile.close()
+
+
+# Append the contents of the file `name' to `outfile', in the kernel if
+# possible.
+def append_file(name: str, outfile: IO[bytes]) -> None:
+    with open(name, "rb") as infile:
+        outfile.flush()
+        try:
+            size = os.fstat(infile.fileno()).st_size
+            while size > 0:
+                copied = os.copy_file_range(infile.fileno(), outfile.fileno(), size)
+                if copied == 0:
+                    break
+                size -= copied
+            if size == 0:
+                current_stats().took("copy_file_range")
+                return
+        except (AttributeError, OSError, io.UnsupportedOperation):
+            pass
+        shutil.copyfileobj(infile, outfile)
+
+
+# Copy the file `name' to `outfile', and return its size. If `outfile' is an
+# empty regular file, it shares the data of `name' if the file system allows
+# it; otherwise the file is copied as append_file does.
+def copy_file(name: str, outfile: IO[bytes]) -> int:
+    size = os.stat(name).st_size
+    outfile.flush()
+    try:
+        # Systems without fcntl, such as Windows, copy the file
+        import fcntl  # pylint: disable=import-outside-toplevel
+
+        if outfile.seekable() and os.fstat(outfile.fileno()).st_size == 0:
+            with open(name, "rb") as infile:
+                fcntl.ioctl(outfile.fileno(), FICLONE, infile.fileno())
+            outfile.seek(0, os.SEEK_END)
+            current_stats().took("reflink")
+            return size
+    except (ImportError, OSError, io.UnsupportedOperation):
+        pass
+    append_file(name, outfile)
+    return size
+
+
+# Append bytes `start' to `stop' of the file `infile' to `outfile', in the
+# kernel if possible, and return how many there were.
+def append_range(infile: IO[bytes], start: int, stop: int, outfile: IO[bytes]) -> int:
+    outfile.flush()
+    offset = start
+    try:
+        while offset < stop:
+            copied = os.copy_file_range(
+                infile.fileno(), outfile.fileno(), stop - offset, offset
+            )
+            if copied == 0:
+                break
+            offset += copied
+    except (AttributeError, OSError, io.UnsupportedOperation):
+        pass
+    if offset < stop:
+        infile.seek(offset)
+        outfile.write(infile.read(stop - offset))
+    return stop - start
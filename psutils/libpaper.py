@@ -4,9 +4,11 @@ Copyright (c) Reuben Thomas 2023.
 Released under the GPL version 3, or (at your option) any later version.
 """
 
+import functools
 import os
 import subprocess
 import re
+from copy import copy
 from typing import List, Optional
 
 from .types import Rectangle
@@ -31,6 +33,13 @@ def paper(cmd: List[str], silent: bool = False) -> Optional[str]:
 
 
 def get_paper_size(paper_name: Optional[str] = None) -> Optional[Rectangle]:
+    size = paper_size(paper_name)
+    return None if size is None else copy(size)
+
+
+# Look up each paper size only once per process, as running `paper' is slow.
+@functools.lru_cache(maxsize=None)
+def paper_size(paper_name: Optional[str]) -> Optional[Rectangle]:
     if paper_name is None:
         paper_name = paper(["--no-size"])
     dimensions: Optional[str] = None
@@ -0,0 +1,427 @@
+"""
+PSUtils output written by several processes.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+With --jobs, the sheets of a document are split into contiguous ranges,
+each written by a separate process, and the results joined in order. With
+--split, every so many sheets are written as a separate document, also by
+separate processes. With --fan-out, each output is written by a separate
+process from the same input.
+
+PostScript segments are joined by appending them. Each PDF segment is a
+document of its own, which is grafted onto the output, with the objects it
+copied from the input shared with the segments before it, as they are when
+one writer copies them all.
+"""
+
+import argparse
+import dataclasses
+import functools
+import json
+import multiprocessing
+import os
+import sys
+import tempfile
+from typing import (
+    IO,
+    TYPE_CHECKING,
+    Any,
+    Callable,
+    Dict,
+    List,
+    Optional,
+    Tuple,
+    Union,
+    cast,
+)
+
+from pypdf import PageObject, PdfReader as PdfReaderBase, PdfWriter
+from pypdf.generic import (
+    ArrayObject,
+    DictionaryObject,
+    IndirectObject,
+    NameObject,
+    NumberObject,
+    PdfObject,
+)
+
+try:
+    from pypdf.generic._link import extract_links
+except ImportError:  # pypdf that does not keep links between pages
+    extract_links = None  # type: ignore
+
+from .argparse import fan_out_argv
+from .cache import job_cache
+from .incremental import incremental_job, write_incremental
+from .io import setup_inputs, write_output
+from .readers import PdfReader, PsReader, document_reader
+from .stats import current_stats, report_stats
+from .trace import span, trace_command
+from .types import Plan, Sheet
+from .warnings import die, warn
+
+if TYPE_CHECKING:
+    from .transformers import DocumentTransform
+
+
+# Return the context in which to start worker processes, which must be
+# forked to share the state of this one, or None, with a warning that
+# `option' is not used, if they cannot be.
+def fork_context(option: str) -> Optional[multiprocessing.context.ForkContext]:
+    if "fork" not in multiprocessing.get_all_start_methods():
+        warn(f"{option} is only used where processes can be forked")
+        return None
+    return multiprocessing.get_context("fork")
+
+
+# Split the sheets into contiguous ranges, write each in a separate process,
+# and join the results in order.
+def write_sheets_parallel(
+    transform: "DocumentTransform", plan: Plan, jobs: int
+) -> None:
+    context = fork_context("--jobs")
+    if context is None:
+        for sheet in plan.sheets:
+            transform.progress.sheet(sheet.pagelabel)
+            transform.write_sheet(plan, sheet)
+        return
+    with span("flush"):
+        transform.outfile.flush()
+    step = -(-len(plan.sheets) // jobs)
+    with tempfile.TemporaryDirectory(prefix="psutils-") as tmpdir:
+        segments = []
+        for start in range(0, len(plan.sheets), step):
+            sheets = plan.sheets[start : start + step]
+            segment = os.path.join(tmpdir, f"segment-{start}")
+            process = context.Process(
+                target=transform.write_segment, args=(plan, sheets, segment)
+            )
+            process.start()
+            segments.append((process, sheets, segment))
+        for process, sheets, segment in segments:
+            process.join()
+            if process.exitcode != 0:
+                die("could not write pages", 2)
+            for sheet in sheets:
+                transform.progress.sheet(sheet.pagelabel)
+            transform.join_segment(segment)
+
+
+# Whether PDF segments can be grafted, which needs objects to be copied
+# without their references being followed.
+CAN_GRAFT = hasattr(PdfObject, "replicate")
+
+
+# The copies a writer makes of the objects of input document number
+# `document', indexed by the number of the original, as PdfWriter keeps
+# them. The number of each copy is recorded with its original, and whether
+# the copy was made because the object had not been copied before, so that
+# other writers may share it, or was forced, as pages and the annotations of
+# merged pages are.
+class CopyRecord(Dict[Any, Any]):
+    def __init__(self, document: int, doc: PdfReaderBase) -> None:
+        super().__init__()
+        super().__setitem__("PreventGC", doc)
+        self.document = document
+        self.missed: Any = None
+        self.forced: Any = None
+        self.copies: Dict[int, Tuple[int, int, bool]] = {}
+
+    def __contains__(self, key: object) -> bool:
+        found = super().__contains__(key)
+        self.missed = None if found else key
+        return found
+
+    def __setitem__(self, key: Any, value: Any) -> None:
+        super().__setitem__(key, value)
+        shared = self.missed == key and self.forced != key
+        self.copies[value] = (self.document, key, shared)
+        self.missed = self.forced = None
+
+    def __delitem__(self, key: Any) -> None:
+        self.missed = None
+        self.forced = key
+        super().__delitem__(key)
+
+
+# A writer of the pages of `documents' that are divided between segments.
+# In a worker, it records where each object it writes came from; links
+# between pages are resolved when the segments have been joined. Otherwise,
+# it joins the segments.
+class SegmentWriter(PdfWriter):  # pylint: disable=abstract-method
+    def __init__(self, documents: List[PdfReaderBase], worker: bool = False):
+        super().__init__()
+        self.documents = documents
+        self.worker = worker
+        # The number of the copy of each input object, by document number
+        # and object number
+        self.copies: Dict[Tuple[int, int], int] = {}
+        if worker:
+            for n, doc in enumerate(documents):
+                self._id_translated[id(doc)] = CopyRecord(n, doc)
+        else:
+            self.input_pages = {
+                (n, reference_number(page.indirect_reference)): page
+                for n, doc in enumerate(documents)
+                for page in doc.pages
+            }
+
+    def _resolve_links(self) -> None:
+        if not self.worker:
+            super()._resolve_links()
+
+    # Write the segment to the file `segment', and where its objects came
+    # from beside it.
+    def write_segment(self, segment: str) -> None:
+        self.write(segment)
+        origins = [
+            [idnum, *origin]
+            for doc in self.documents
+            for idnum, origin in cast(
+                CopyRecord, self._id_translated[id(doc)]
+            ).copies.items()
+        ]
+        with open(f"{segment}.json", "w", encoding="utf-8") as f:
+            json.dump(origins, f)
+
+    # Replace the references in `obj' to objects of a segment with references
+    # to their copies, numbered by `numbers'.
+    def renumber(self, obj: Any, numbers: Dict[int, int]) -> None:
+        if isinstance(obj, DictionaryObject):
+            items = list(obj.items())
+        elif isinstance(obj, ArrayObject):
+            items = list(enumerate(obj))
+        else:
+            return
+        for key, value in items:
+            if isinstance(value, IndirectObject):
+                obj[key] = IndirectObject(numbers[value.idnum], 0, self)
+            else:
+                self.renumber(value, numbers)
+
+    # Copy the objects of the segment written to the file `segment' by
+    # write_segment, except those copied from the input that are already
+    # here, and append its pages.
+    def join_segment(self, segment: str) -> None:
+        with open(f"{segment}.json", encoding="utf-8") as f:
+            origins: Dict[int, Tuple[int, int]] = {}
+            shared = set()
+            for idnum, n, src, is_shared in json.load(f):
+                origins[idnum] = (n, src)
+                if is_shared:
+                    shared.add(idnum)
+        reader = PdfReaderBase(segment)
+        trailer = reader.trailer
+        pages = cast(DictionaryObject, self.root_object["/Pages"])
+        numbers = {
+            reference_number(trailer.raw_get("/Root")): reference_number(
+                self.root_object.indirect_reference
+            ),
+            reference_number(reader.root_object.raw_get("/Pages")): reference_number(
+                pages.indirect_reference
+            ),
+            reference_number(trailer.raw_get("/Info")): reference_number(
+                self._info.indirect_reference if self._info is not None else None
+            ),
+        }
+        new: List[int] = []
+        for idnum in range(1, cast(int, trailer["/Size"])):
+            if idnum in numbers:
+                continue
+            origin = origins.get(idnum)
+            if origin is not None and idnum in shared and origin in self.copies:
+                numbers[idnum] = self.copies[origin]
+                continue
+            numbers[idnum] = len(self._objects) + len(new) + 1
+            new.append(idnum)
+            if origin is not None:
+                self.copies[origin] = numbers[idnum]
+
+        # Copy pages as pages, so that they are added to the page list
+        segment_pages: Dict[int, PdfObject] = {
+            reference_number(page.indirect_reference): page for page in reader.pages
+        }
+        for idnum in new:
+            obj = segment_pages.get(idnum) or cast(PdfObject, reader.get_object(idnum))
+            copy = obj.replicate(self)
+            assert reference_number(copy.indirect_reference) == numbers[idnum]
+            self.renumber(copy, numbers)
+        for page in reader.pages:
+            idnum = reference_number(page.indirect_reference)
+            new_page = cast(PageObject, self.get_object(numbers[idnum]))
+            cast(ArrayObject, pages["/Kids"]).append(new_page.indirect_reference)
+            pages[NameObject("/Count")] = NumberObject(cast(int, pages["/Count"]) + 1)
+            cast(List[PageObject], self.flattened_pages).append(new_page)
+            # Resolve the links of pages copied from the input when the
+            # output is written, as add_page does
+            origin = origins.get(idnum)
+            if origin is not None and extract_links is not None:
+                page_org = self.input_pages[origin]
+                self._unresolved_links.extend(extract_links(new_page, page_org))
+                self._merged_in_pages[page_org.indirect_reference] = (
+                    new_page.indirect_reference
+                )
+        self.pdf_header = max(self.pdf_header, reader.pdf_header)
+        self.reset_translation(reader)
+
+
+# The object number of the reference `reference'.
+def reference_number(reference: Optional[PdfObject]) -> int:
+    assert isinstance(reference, IndirectObject)
+    return reference.idnum
+
+
+# Write the sheets in `sheets' of `transform' as a complete document to the
+# file `name'; run in a worker process.
+def write_chunk(
+    transform: "DocumentTransform", plan: Plan, sheets: List[Sheet], name: str
+) -> None:
+    try:
+        outfile = open(name, "wb")
+    except IOError:
+        die(f"cannot open output file {name}")
+    with outfile:
+        transform.outfile = outfile
+        chunk = Plan(plan.page_list, plan.maxpage, plan.modulo, [])
+        for sheet in sheets:
+            chunk.sheets.append(
+                dataclasses.replace(sheet, outputpage=len(chunk.sheets) + 1)
+            )
+        transform.write_header(chunk)
+        for sheet in chunk.sheets:
+            transform.write_sheet(chunk, sheet)
+        transform.finalize()
+
+
+# Write every `split' sheets as a separate document, named by `template' with
+# the number of the document, in concurrent processes.
+def write_sheets_split(
+    transform: "DocumentTransform", plan: Plan, split: int, template: Optional[str]
+) -> None:
+    if template is None or template == "-":
+        die("an output file name is needed to split the output")
+    try:
+        numbered = template % 1 != template % 2
+    except (TypeError, ValueError):
+        numbered = False
+    if not numbered:
+        die("output file name must contain %d when splitting the output")
+    names = [template % n for n in range(1, -(-len(plan.sheets) // split) + 1)]
+    context = fork_context("--split")
+    if context is None:
+        for i, name in enumerate(names):
+            sheets = plan.sheets[i * split : (i + 1) * split]
+            write_chunk(transform, plan, sheets, name)
+            for sheet in sheets:
+                transform.progress.sheet(sheet.pagelabel)
+        return
+    with span("flush"):
+        transform.outfile.flush()
+    processes: List[Tuple[multiprocessing.process.BaseProcess, List[Sheet]]]
+    processes = []
+
+    def join_first() -> None:
+        process, sheets = processes.pop(0)
+        process.join()
+        if process.exitcode != 0:
+            die("could not write pages", 2)
+        for sheet in sheets:
+            transform.progress.sheet(sheet.pagelabel)
+
+    for i, name in enumerate(names):
+        if len(processes) >= (os.cpu_count() or 1):
+            join_first()
+        sheets = plan.sheets[i * split : (i + 1) * split]
+        process = context.Process(
+            target=write_chunk, args=(transform, plan, sheets, name)
+        )
+        process.start()
+        processes.append((process, sheets))
+    while len(processes) > 0:
+        join_first()
+
+
+# Return the name of the file to open for the output given by `args'. When
+# the output is split, transform_pages writes the files, so this is a
+# placeholder.
+def output_name(args: argparse.Namespace) -> Optional[str]:
+    return os.devnull if args.split > 0 else args.outfile
+
+
+# Write each of `outputs', given as an output file name and a function that
+# writes to it, from `doc'. Several outputs are written by concurrent
+# processes, which share the input and its index.
+def write_outputs(
+    doc: Union[PdfReader, PsReader],
+    outputs: List[Tuple[Optional[str], Callable[[IO[bytes]], None]]],
+) -> None:
+    if len(outputs) == 1:
+        write_output(*outputs[0])
+        return
+    if len([name for name, _ in outputs if name in (None, "-")]) > 1:
+        die("only one output can be standard output")
+    current_stats().took("fan-out")
+    if isinstance(doc, PsReader):
+        doc.read_all()
+        doc.share()
+    context = fork_context("--fan-out")
+    if context is None:
+        for output in outputs:
+            write_output(*output)
+        return
+    sys.stdout.flush()
+    sys.stderr.flush()
+    processes = [
+        context.Process(target=write_output, args=output) for output in outputs
+    ]
+    for process in processes:
+        process.start()
+    for process in processes:
+        process.join()
+    for process in processes:
+        # A negative exit code means the process was killed by a signal
+        code = process.exitcode or 0
+        if code != 0:
+            sys.exit(code if code > 0 else 2)
+
+
+# Run a command whose arguments are parsed from `argv' by `get_args', and
+# that writes one output with `write', once for the command line and once
+# for each --fan-out argument, reading the input only once. Commands without
+# --fan-out or --append write one output from one input.
+def fan_out(
+    argv: List[str],
+    get_args: Callable[[List[str]], argparse.Namespace],
+    write: Callable[[Union[PdfReader, PsReader], argparse.Namespace, IO[bytes]], None],
+) -> None:
+    args = get_args(argv)
+    all_args = [args]
+    appended = getattr(args, "append", [])
+    for text in getattr(args, "fan_out", []):
+        fan_out_args = get_args(fan_out_argv(text, args.infile))
+        if len(fan_out_args.fan_out) > 0:
+            die("--fan-out cannot be given inside --fan-out")
+        if len(fan_out_args.append) > 0:
+            die("--append cannot be given inside --fan-out")
+        all_args.append(fan_out_args)
+    incremental = incremental_job(args)
+    with trace_command(), report_stats(args.stats):
+        with setup_inputs([args.infile, *appended]) as inputs:
+            cache = job_cache(args, [infile for infile, _ in inputs], write)
+            if cache is not None:
+                cache.write_output(
+                    args.outfile,
+                    lambda outfile: write(
+                        document_reader(*inputs[0], inputs[1:]), args, outfile
+                    ),
+                )
+                return
+            doc = document_reader(*inputs[0], inputs[1:])
+            if incremental:
+                write_incremental(args.outfile, functools.partial(write, doc, args))
+                return
+            write_outputs(
+                doc,
+                [(output_name(a), functools.partial(write, doc, a)) for a in all_args],
+            )
@@ -0,0 +1,141 @@
+"""
+PSUtils pipelines of commands run as a single transformation.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+"""
+
+import argparse
+import shlex
+from typing import IO, Callable, Dict, List, Optional, Tuple, Union
+
+from .argparse import parserange
+from .command import psbook, psnup, psselect, pstops
+from .readers import PdfReader, PsReader
+from .types import PageList, Range
+from .warnings import die
+
+
+# The commands that may be used in a pipeline, and their argument parsers
+STAGE_PARSERS: Dict[str, Callable[[List[str]], argparse.Namespace]] = {
+    "psselect": psselect.get_args,
+    "psbook": psbook.get_args,
+    "pstops": pstops.get_args,
+    "psnup": psnup.get_args,
+}
+
+# Commands that put pages on to sheets, which must end a pipeline
+IMPOSITION_STAGES = ("pstops", "psnup")
+
+
+# Select pages from `pages', a list of input page indices (-1 for a blank
+# page), in the way PageList selects them from a whole document.
+def select_pages(
+    pages: List[int],
+    pagerange: Optional[List[Range]],
+    reverse: bool,
+    odd: bool,
+    even: bool,
+) -> List[int]:
+    if pagerange is None:
+        pagerange = parserange("1-_1")
+
+    def abs_page(n: int) -> int:
+        if n < 0:
+            n += len(pages) + 1
+            n = max(n, 1)
+        return n
+
+    ranges = [Range(abs_page(r.start), abs_page(r.end), r.text) for r in pagerange]
+    page_list = PageList(len(pages), ranges, reverse, odd, even)
+    return [pages[p] if p >= 0 else -1 for p in page_list.pages]
+
+
+class Pipeline:
+    """A pipeline of psselect, psbook, pstops and psnup commands.
+
+    The pipeline is written like a shell pipeline, without file names, for
+    example `psselect 1-16 | psbook -s8 | psnup -2'. Rather than writing
+    each intermediate document, the page selections of all the commands are
+    composed into a single list of input pages, which the last command
+    then puts on to sheets. Only the last command may be pstops or psnup;
+    pstops options that select pages are honoured only there too.
+    """
+
+    def __init__(self, text: str) -> None:
+        self.stages: List[Tuple[str, argparse.Namespace]] = []
+        stage_texts = text.split("|")
+        for i, stage_text in enumerate(stage_texts):
+            words = shlex.split(stage_text)
+            if len(words) == 0:
+                die("empty command in pipeline")
+            name = words[0]
+            if name not in STAGE_PARSERS:
+                die(f"`{name}' cannot be used in a pipeline")
+            if name in IMPOSITION_STAGES and i < len(stage_texts) - 1:
+                die(f"{name} can only be the last command in a pipeline")
+            args = STAGE_PARSERS[name](words[1:])
+            if (
+                args.infile is not None
+                or args.outfile is not None
+                or len(getattr(args, "append", [])) > 0
+            ):
+                die(f"`{stage_text.strip()}' must not name a file")
+            if getattr(args, "fan_out", None):
+                die("--fan-out cannot be used in a pipeline")
+            if args.split > 0:
+                die("--split cannot be used in a pipeline")
+            self.stages.append((name, args))
+
+    # Return the input pages selected by the pipeline, as indices into
+    # a document of `num_pages' pages, with -1 for a blank page.
+    def pages(self, num_pages: int) -> List[int]:
+        pages = list(range(num_pages))
+        for name, args in self.stages:
+            if name == "psselect":
+                pagerange = parserange(args.pages) if args.pages is not None else None
+                pages = select_pages(
+                    pages, pagerange, args.reverse, args.odd, args.even
+                )
+            elif name == "psbook":
+                pages = [
+                    pages[page - 1] if page > 0 else -1
+                    for page in psbook.book_order(len(pages), args.signature)
+                ]
+            elif name == "pstops":
+                pages = select_pages(
+                    pages, args.pagerange, args.reverse, args.odd, args.even
+                )
+        return pages
+
+    def run(
+        self,
+        doc: Union[PdfReader, PsReader],
+        outfile: IO[bytes],
+        verbose: bool,
+        jobs: int = 1,
+        pipeline: bool = False,
+        page_labels: bool = False,
+    ) -> None:
+        pagerange = [
+            Range(page + 1, page + 1, str(page + 1)) if page >= 0 else Range(0, 0, "_")
+            for page in self.pages(doc.total_pages())
+        ]
+
+        # Put the pages on to sheets with the last command, or one page per
+        # sheet if it does not impose them.
+        name, args = self.stages[-1]
+        if name not in IMPOSITION_STAGES:
+            name, args = "pstops", pstops.get_args(["-S", pstops.DEFAULT_SPECS])
+        args = argparse.Namespace(
+            **{
+                **vars(args),
+                "verbose": verbose,
+                "jobs": jobs,
+                "pipeline": pipeline,
+                "page_labels": page_labels,
+            }
+        )
+        if name == "psnup":
+            psnup.impose(doc, args, outfile, pagerange)
+        else:
+            pstops.rearrange(doc, args, outfile, pagerange)
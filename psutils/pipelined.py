@@ -0,0 +1,94 @@
+"""
+PSUtils output written in overlapping stages.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+With --pipeline, reading the input pages of a sheet, building the sheet and
+writing it run on separate threads, so that each can go on while another
+waits.
+"""
+
+import contextvars
+import io
+import queue
+import threading
+from typing import TYPE_CHECKING, Dict, List, Optional, Union
+
+from .types import Plan
+
+if TYPE_CHECKING:
+    from .transformers import DocumentTransform
+
+# Number of sheets that may wait between each pair of pipeline stages.
+PIPELINE_DEPTH = 8
+
+
+# Write the sheets of `transform' in three stages: a thread reads the input
+# pages of upcoming sheets, this thread builds each sheet in memory, and
+# another thread writes finished sheets. The queues between the stages are
+# bounded, so only a few sheets are held in memory at once.
+def write_sheets_pipelined(transform: "DocumentTransform", plan: Plan) -> None:
+    outfile = transform.outfile
+    pages_queue: queue.Queue[Union[Dict[int, bytes], BaseException]]
+    pages_queue = queue.Queue(PIPELINE_DEPTH)
+    output_queue: queue.Queue[Optional[bytes]] = queue.Queue(PIPELINE_DEPTH)
+    errors: List[BaseException] = []
+    stopped = threading.Event()
+
+    def read() -> None:
+        try:
+            for sheet in plan.sheets:
+                if stopped.is_set():
+                    return
+                pages = transform.sheet_sources(plan, sheet)
+                pages_queue.put(
+                    transform.read_pages([page for page in pages if page is not None])
+                )
+        except BaseException as e:  # pylint: disable=broad-exception-caught
+            pages_queue.put(e)
+
+    def write() -> None:
+        try:
+            while (data := output_queue.get()) is not None:
+                outfile.write(data)
+        except BaseException as e:  # pylint: disable=broad-exception-caught
+            errors.append(e)
+            while output_queue.get() is not None:
+                pass
+
+    # The threads run in copies of this context, so that they report errors
+    # and messages as this job does
+    reader = threading.Thread(
+        target=contextvars.copy_context().run, args=(read,), daemon=True
+    )
+    writer = threading.Thread(
+        target=contextvars.copy_context().run, args=(write,), daemon=True
+    )
+    reader.start()
+    writer.start()
+    try:
+        for sheet in plan.sheets:
+            pages = pages_queue.get()
+            if isinstance(pages, BaseException):
+                raise pages
+            if errors:
+                break
+            transform.progress.sheet(sheet.pagelabel)
+            transform.outfile = io.BytesIO()
+            transform.page_data = pages
+            transform.write_sheet(plan, sheet)
+            output_queue.put(transform.outfile.getvalue())
+    finally:
+        # Unblock and stop the reader, and let the writer finish.
+        stopped.set()
+        while reader.is_alive():
+            try:
+                pages_queue.get(timeout=0.01)
+            except queue.Empty:
+                pass
+        output_queue.put(None)
+        writer.join()
+        transform.outfile = outfile
+        transform.page_data = {}
+    if errors:
+        raise errors[0]
@@ -0,0 +1,78 @@
+"""
+PSUtils progress reporting.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+"""
+
+import time
+from typing import Optional
+
+from .stats import Stats
+from .warnings import diagnostics
+
+# The least time in seconds between updates of the status line
+INTERVAL = 0.25
+
+
+class Progress:
+    """Reports the sheets written by a job to its diagnostics. With
+    `page_labels', each sheet's label is written as it is done; otherwise,
+    on a terminal, a status line is updated at most every INTERVAL seconds,
+    and elsewhere only a summary is written at the end. Nothing is reported
+    unless `verbose'."""
+
+    def __init__(self, verbose: bool, page_labels: bool, stats: Stats) -> None:
+        # How sheets are reported: "labels", "status" or "summary", or None
+        # if they are not
+        self.mode: Optional[str] = None
+        if verbose:
+            if page_labels:
+                self.mode = "labels"
+            elif diagnostics().isatty():
+                self.mode = "status"
+            else:
+                self.mode = "summary"
+        self.stats = stats
+        # The number of sheets to be written, if known
+        self.total: Optional[int] = None
+        self.sheets = 0
+        self.start = time.monotonic()
+        self.last_update = self.start
+        self.line_length = 0
+
+    def sheet(self, pagelabel: str) -> None:
+        self.sheets += 1
+        if self.mode == "labels":
+            diagnostics().write(f"[{pagelabel}] ")
+        elif self.mode == "status":
+            now = time.monotonic()
+            if now - self.last_update >= INTERVAL:
+                self.last_update = now
+                count = f"{self.sheets}"
+                if self.total is not None:
+                    count += f"/{self.total}"
+                self.show(f"{count} pages, {self.rates(now)}")
+
+    def done(self, sheets: int) -> None:
+        if self.mode == "labels":
+            diagnostics().write(f"\nWrote {sheets} pages\n")
+        elif self.mode == "status":
+            self.show(f"Wrote {sheets} pages, {self.rates(time.monotonic())}")
+            diagnostics().write("\n")
+        elif self.mode == "summary":
+            diagnostics().write(f"Wrote {sheets} pages\n")
+
+    # Return the rates of writing so far, and, if possible, the time left.
+    def rates(self, now: float) -> str:
+        elapsed = max(now - self.start, 1e-6)
+        rate = self.sheets / elapsed
+        written = self.stats.bytes_copied + self.stats.bytes_generated
+        text = f"{rate:.0f} pages/s, {written / elapsed / 1e6:.1f} MB/s"
+        if self.total is not None and self.sheets < self.total and rate > 0:
+            text += f", {(self.total - self.sheets) / rate:.0f}s left"
+        return text
+
+    # Replace the status line with `text'.
+    def show(self, text: str) -> None:
+        diagnostics().write("\r" + text.ljust(self.line_length))
+        self.line_length = len(text)
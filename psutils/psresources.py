@@ -6,9 +6,53 @@ Released under the GPL version 3, or (at your option) any later version.
 
 import os
 import re
+from typing import List, Optional, Set, Tuple
 
+from .readers import PsReader, remove_resources
 from .warnings import die
 
+# PStoPS procset
+# Wrap showpage, erasepage and copypage in our own versions.
+# Nullify paper size operators.
+PROCSET = """userdict begin
+[/showpage/erasepage/copypage]{dup where{pop dup load
+ type/operatortype eq{ /PStoPSenablepage cvx 1 index
+ load 1 array astore cvx {} bind /ifelse cvx 4 array
+ astore cvx def}{pop}ifelse}{pop}ifelse}forall
+ /PStoPSenablepage true def
+[/letter/legal/executivepage/a4/a4small/b5/com10envelope
+ /monarchenvelope/c5envelope/dlenvelope/lettersmall/note
+ /folio/quarto/a5]{dup where{dup wcheck{exch{}put}
+ {pop{}def}ifelse}{pop}ifelse}forall
+/setpagedevice {pop}bind 1 index where{dup wcheck{3 1 roll put}
+ {pop def}ifelse}{def}ifelse
+/PStoPSmatrix matrix currentmatrix def
+/PStoPSxform matrix def/PStoPSclip{clippath}def
+/defaultmatrix{PStoPSmatrix exch PStoPSxform exch concatmatrix}bind def
+/initmatrix{matrix defaultmatrix setmatrix}bind def"""
+
+# Redefine initclip and initgraphics to respect the clipping path of the
+# placed page. The light procset omits these, so it only works for input
+# that does not call initclip or initgraphics.
+PROCSET_INITCLIP = """/initclip[{matrix currentmatrix PStoPSmatrix setmatrix
+ [{currentpoint}stopped{$error/newerror false put{newpath}}
+ {/newpath cvx 3 1 roll/moveto cvx 4 array astore cvx}ifelse]
+ {[/newpath cvx{/moveto cvx}{/lineto cvx}
+ {/curveto cvx}{/closepath cvx}pathforall]cvx exch pop}
+ stopped{$error/errorname get/invalidaccess eq{cleartomark
+ $error/newerror false put cvx exec}{stop}ifelse}if}bind aload pop
+ /initclip dup load dup type dup/operatortype eq{pop exch pop}
+ {dup/arraytype eq exch/packedarraytype eq or
+  {dup xcheck{exch pop aload pop}{pop cvx}ifelse}
+  {pop cvx}ifelse}ifelse
+ {newpath PStoPSclip clip newpath exec setmatrix} bind aload pop]cvx def
+/initgraphics{initmatrix newpath initclip 1 setlinewidth
+ 0 setlinecap 0 setlinejoin []0 setdash 0 setgray
+ 10 setmiterlimit}bind def"""
+
+# Characters that end a PostScript name
+NAME_DELIMITERS = rb"\s()<>\[\]{}/%"
+
 
 # Resource extensions
 def extn(ext: bytes) -> bytes:
@@ -34,3 +78,95 @@ def filename(*components: bytes) -> bytes:  # make filename for resource in 'com
     if name == b"":
         die(f'filename not found for resource {b" ".join(components).decode()}', 2)
     return name
+
+
+# Return a pattern that finds the PostScript name `name' as a token, with or
+# without a slash, or as a string.
+def name_pattern(name: bytes) -> "re.Pattern[bytes]":
+    token = rb"[^" + NAME_DELIMITERS + rb"]"
+    return re.compile(
+        rb"(?<!" + token + rb")" + re.escape(name) + rb"(?!" + token + rb")"
+    )
+
+
+# Return the resources supplied by the document read by `reader' that pages
+# with the resources `page_resources' do not use, and the locations of those
+# to skip, which are fonts and any resources inside them. We can only tell if
+# every page lists its resources, and keep any font that might be used
+# elsewhere: one that the prolog and setup say they need, or whose name
+# appears in them outside the fonts we skip.
+def unused_resources(
+    reader: PsReader,
+    page_resources: List[Optional[Set[Tuple[bytes, bytes]]]],
+) -> Tuple[Set[Tuple[bytes, bytes]], List[range]]:
+    used = set(reader.needed_resources)
+    for resources in page_resources:
+        if resources is None:
+            return set(), []
+        used.update(resources)
+
+    # Resources inside another go with it
+    located = [
+        (resource, r) for resource, ranges in reader.resources.items() for r in ranges
+    ]
+    outer = [
+        (resource, r)
+        for resource, r in located
+        if not any(
+            o != r and o.start <= r.start and r.stop <= o.stop for _, o in located
+        )
+    ]
+    unused = {
+        resource
+        for resource, _ in outer
+        if resource[0] == b"font" and resource not in used
+    }
+    unused -= {resource for resource, r in located if (resource, r) not in outer}
+
+    # Keep fonts named in the prolog and setup outside the fonts we skip,
+    # until no more are found
+    start = reader.headerpos
+    prolog = reader.prolog()
+    while len(unused) > 0:
+        skip = sorted(
+            (r for resource, r in outer if resource in unused),
+            key=lambda r: r.start,
+        )
+        kept, pos = [], 0
+        for r in skip:
+            kept.append(prolog[pos : max(r.start - start, pos)])
+            pos = max(r.stop - start, pos)
+        kept.append(prolog[pos:])
+        text = b"".join(kept)
+        named = {
+            resource for resource in unused if name_pattern(resource[1]).search(text)
+        }
+        if len(named) == 0:
+            break
+        unused -= named
+
+    skip = [r for resource, r in outer if resource in unused]
+    pruned = {
+        resource
+        for resource, r in located
+        if any(o.start <= r.start and r.stop <= o.stop for o in skip)
+    }
+    return pruned, skip
+
+
+# Return the locations of the header comments of the document read by
+# `reader' that list the resources it supplies, and the comments to give
+# instead, without the resources in `pruned'.
+def supplied_comments(
+    reader: PsReader, pruned: Set[Tuple[bytes, bytes]]
+) -> Tuple[List[int], List[bytes]]:
+    records: List[int] = []
+    comments: List[bytes] = []
+    for keyword, lines in reader.supplied_comments:
+        records.extend(record for record, _ in lines)
+        values = [remove_resources(keyword, value, pruned) for _, value in lines]
+        values = [value for value in values if value != b""]
+        for i, value in enumerate(values):
+            prefix = b"%%" + keyword + b": " if i == 0 else b"%%+ "
+            comments.append(prefix + value)
+    return records, comments
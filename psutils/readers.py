@@ -6,11 +6,14 @@ Released under the GPL version 3, or (at your option) any later version.
 
 from pathlib import Path
 import re
-from typing import List, Tuple, Union, Type, IO
+from typing import Dict, Iterator, List, Optional, Sequence, Set, Tuple, Union, Type, IO
 
-from pypdf import PdfReader as PdfReaderBase
+from pypdf import PageObject, PdfReader as PdfReaderBase
 from pypdf._utils import StrByteType
 
+from .io import MappedFile, ReadAhead, StreamWindow
+from .stats import current_stats
+from .trace import span
 from .types import Rectangle
 from .warnings import die
 
@@ -22,11 +25,93 @@ class PdfReader(PdfReaderBase):
         strict: bool = False,
         password: Union[str, bytes, None] = None,
     ) -> None:
-        super().__init__(stream, strict, password)
+        with current_stats().phase("load"):
+            super().__init__(stream, strict, password)
         assert len(self.pages) > 0
         mediabox = self.pages[0].mediabox
         self.size = Rectangle(mediabox.width, mediabox.height)
         self.size_guessed = False
+        # Documents whose pages follow this one's; see append
+        self.appended: List[PdfReader] = []
+
+    # Follow this document with `other', as if they had been joined.
+    def append(self, other: "PdfReader") -> None:
+        self.appended.append(other)
+
+    # Return this document and those appended to it.
+    def documents(self) -> List[PdfReaderBase]:
+        return [self, *self.appended]
+
+    # Return the pages of this document and of those appended to it.
+    def all_pages(self) -> List[PageObject]:
+        return [page for doc in self.documents() for page in doc.pages]
+
+    def total_pages(self) -> int:
+        return len(self.pages) + sum(len(doc.pages) for doc in self.appended)
+
+
+resource_types = (
+    b"font",
+    b"file",
+    b"procset",
+    b"pattern",
+    b"form",
+    b"encoding",
+)
+
+page_resource_keywords = (
+    b"PageResources",
+    b"IncludeResource",
+    b"PageFonts",
+    b"IncludeFont",
+)
+
+# Header comments that list the resources the document supplies, and
+# comments that name resources it needs in its prolog or setup
+supplied_resource_keywords = (
+    b"DocumentSuppliedResources",
+    b"DocumentSuppliedFonts",
+    b"DocumentFonts",
+)
+needed_resource_keywords = (
+    b"DocumentNeededResources",
+    b"DocumentNeededFonts",
+    b"IncludeResource",
+    b"IncludeFont",
+)
+
+
+# Parse a DSC resource list into (type, name) pairs; DSC 2 font comments
+# omit the type.
+def resource_list(keyword: bytes, value: bytes) -> List[Tuple[bytes, bytes]]:
+    resources = []
+    fonts_only = keyword.endswith((b"Font", b"Fonts"))
+    resource_type = b"font" if fonts_only else b""
+    for word in value.split():
+        if not fonts_only and word in resource_types:
+            resource_type = word
+        elif resource_type != b"":
+            resources.append((resource_type, word))
+    return resources
+
+
+# Remove the resources in `removed' from `value', the value of a DSC
+# resource list, dropping resource types with no names left.
+def remove_resources(
+    keyword: bytes, value: bytes, removed: Set[Tuple[bytes, bytes]]
+) -> bytes:
+    words: List[bytes] = []
+    fonts_only = keyword.endswith((b"Font", b"Fonts"))
+    resource_type = b"font" if fonts_only else b""
+    type_word: List[bytes] = []
+    for word in value.split():
+        if not fonts_only and word in resource_types:
+            resource_type, type_word = word, [word]
+        elif (resource_type, word) not in removed:
+            words.extend(type_word)
+            words.append(word)
+            type_word = []
+    return b" ".join(words)
 
 
 size_keywords = (
@@ -38,26 +123,165 @@ size_keywords = (
 
 
 # FIXME: Store lists of lines, not file offsets.
-class PsReader:  # pylint: disable=too-many-instance-attributes,too-few-public-methods
+class PsReader:  # pylint: disable=too-many-instance-attributes
     def __init__(self, infile: IO[bytes]) -> None:
         self.infile = infile
         self.headerpos: int = 0
         self.pagescmt: int = 0
+        self.creationdate: int = 0
         self.endsetup: int = 0
         self.procset_pos: range = range(0, 0)  # pstops procset location
-        self.num_pages: int = 0
+        self.procset_specs: range = range(0, 0)  # its spec procedures
+        self.procset_spec_count: int = 0
+        self.procset_initclip = False  # whether the procset redefines initclip
+        # Resources supplied in the prolog and setup, including those inside
+        # others, resources needed by the prolog and setup, and resources
+        # used by each page (None if the page does not say)
+        self.resources: Dict[Tuple[bytes, bytes], List[range]] = {}
+        self.needed_resources: Set[Tuple[bytes, bytes]] = set()
+        self.page_resources: List[Optional[Set[Tuple[bytes, bytes]]]] = []
+        # The header comments that list supplied resources, with the location
+        # and value of each of their lines
+        self.supplied_comments: List[Tuple[bytes, List[Tuple[int, bytes]]]] = []
+        self.num_pages: int = 0  # pages indexed so far; see total_pages
         self.sizeheaders: List[int] = []
         self.pageptr: List[int] = []
-        self.size = None
+        self.size: Optional[Rectangle] = None
         self.size_guessed = False
+        self.read_ahead: Optional[ReadAhead] = None
+        # Whether other processes read the input at the same time
+        self.shared = False
+        # Documents whose pages follow this one's; see append
+        self.appended: List[PsReader] = []
 
-        nesting = 0
+        # The input is indexed up to the first page, and the rest as it is
+        # needed; see index_page. Input that can only be read forwards is
+        # released as it is used; see release.
+        self.streaming = isinstance(infile, StreamWindow)
+        self.indexed = False
         self.infile.seek(0)
+        self.scanner = self.scan()
+        with current_stats().phase("scan"):
+            next(self.scanner, None)
+
+    # Index the input up to the end of page `n', or all of it if `n' is
+    # None; return whether page `n' exists.
+    def index_page(self, n: Optional[int] = None) -> bool:
+        if (n is None or self.num_pages <= n) and not self.indexed:
+            with current_stats().phase("scan"):
+                while (n is None or self.num_pages <= n) and not self.indexed:
+                    next(self.scanner, None)
+        return n is None or n < self.num_pages
+
+    # Return whether page `n', counting the pages of appended documents,
+    # exists, indexing the input only as far as needed.
+    def has_page(self, n: int) -> bool:
+        return n >= 0 and (self.index_page(n) or n < self.total_pages())
+
+    # Tell the kernel the order in which the given pages will be read, if the
+    # input is mapped.
+    def plan_reads(self, pages: List[int]) -> None:
+        raw = getattr(self.infile, "raw", None)
+        if isinstance(raw, MappedFile):
+            self.read_ahead = ReadAhead(
+                raw,
+                [range(self.pageptr[p], self.pageptr[p + 1]) for p in pages],
+                not self.shared,
+            )
+
+    # Return the body of page `n', without its %%Page comment.
+    def read_page(self, n: int) -> bytes:
+        start, stop = self.pageptr[n], self.pageptr[n + 1]
+        if self.read_ahead is not None:
+            self.read_ahead.reading(start)
+        raw = getattr(self.infile, "raw", None)
+        if isinstance(raw, MappedFile):
+            # Read mapped input with pread, which, unlike the seek and read
+            # below, can be used by several threads at once
+            try:
+                page = raw.pread(start, stop)
+            except OSError:
+                die("I/O error", 2)
+            return page[page.find(b"\n") + 1 :]
+        self.infile.seek(start)
+        try:
+            line = self.infile.readline()
+            keyword, _ = self.comment(line)
+            assert keyword == b"Page"
+        except IOError:
+            die(f"I/O error seeking page {n}", 2)
+        try:
+            return self.infile.read(stop - self.infile.tell())
+        except IOError:
+            die("I/O error", 2)
+
+    # Note that other processes will read the input at the same time, so
+    # that pages are not dropped from the cache when this one has read them.
+    def share(self) -> None:
+        for doc in [self, *self.appended]:
+            doc.shared = True
+
+    # Index and keep all of the input, so that it can be read in any order.
+    def read_all(self) -> None:
+        self.index_page()
+        self.streaming = False
+
+    # Follow this document with `other', as if they had been joined. Pages
+    # are numbered across the documents, so both are indexed completely.
+    def append(self, other: "PsReader") -> None:
+        self.read_all()
+        other.read_all()
+        self.appended.append(other)
+
+    # Return the number of pages, including those of appended documents.
+    def total_pages(self) -> int:
+        self.index_page()
+        return self.num_pages + sum(doc.num_pages for doc in self.appended)
+
+    # Return the prolog and setup of the document.
+    def prolog(self) -> bytes:
+        self.infile.seek(self.headerpos)
+        return self.infile.read(self.pageptr[0] - self.headerpos)
+
+    # Return the code to put around each page of this document when it is
+    # appended to one with the prolog `prolog': unless the prologs are the
+    # same, the page runs in its own save context after this document's
+    # prolog, as psjoin does it, with its DSC comments disabled.
+    def page_wrapper(self, prolog: bytes) -> Tuple[bytes, bytes]:
+        own_prolog = self.prolog()
+        if own_prolog == prolog:
+            return b"", b""
+        self.infile.seek(self.pageptr[self.num_pages])
+        trailer = self.infile.read()
+        return (
+            b"userdict/PStoPSsourcesaved save put\n"
+            + re.sub(b"^%%", b"% %%", own_prolog, flags=re.MULTILINE),
+            re.sub(b"^%%", b"% %%", trailer, flags=re.MULTILINE)
+            + b"PStoPSsourcesaved restore\n",
+        )
+
+    # Discard input before `offset', if it can only be read forwards.
+    def release(self, offset: int) -> None:
+        if isinstance(self.infile, StreamWindow):
+            self.infile.release(offset)
+
+    # Index the file, pausing at the start of each page, when the pages
+    # before it are complete.
+    def scan(self) -> Iterator[None]:
+        nesting = 0
         record, next_record, buffer = 0, 0, None
+        prev_record, specs_start = 0, 0
+        # The resources being read, innermost last, and where they start
+        open_resources: List[Tuple[Optional[Tuple[bytes, bytes]], int]] = []
+        continued = b""
         file_sizes = {}
         for buffer in self.infile:
             next_record += len(buffer)
-            if buffer.startswith(b"%%"):
+            if not buffer.startswith(b"%%+"):
+                continued = b""
+            if continued != b"":
+                self.resource_comment(continued, record, buffer[3:], True)
+            elif buffer.startswith(b"%%"):
                 keyword, value = self.comment(buffer)
                 if keyword is not None:
                     # If input paper size is not set, try to read it
@@ -87,19 +311,68 @@ class PsReader:  # pylint: disable=too-many-instance-attributes,too-few-public-m
                             except ValueError:
                                 pass
                     if nesting == 0 and keyword == b"Page":
+                        if len(self.pageptr) == 0:
+                            self.set_size(file_sizes)
+                            if self.endsetup == 0:
+                                self.endsetup = record
                         self.pageptr.append(record)
+                        self.page_resources.append(None)
+                        self.num_pages = len(self.pageptr) - 1
+                        yield
+                        self.infile.seek(next_record)
+                    elif (
+                        nesting == 0
+                        and len(self.pageptr) > 0
+                        and keyword in page_resource_keywords
+                    ):
+                        assert value is not None
+                        self.add_page_resources(keyword, value)
+                        continued = keyword
+                    elif (
+                        nesting == 0
+                        and len(self.pageptr) == 0
+                        and (
+                            keyword in needed_resource_keywords
+                            or (
+                                self.headerpos == 0
+                                and keyword in supplied_resource_keywords
+                            )
+                        )
+                    ):
+                        assert value is not None
+                        self.resource_comment(keyword, record, value, False)
+                        continued = keyword
+                    elif (
+                        nesting == 0
+                        and len(self.pageptr) == 0
+                        and keyword in (b"BeginResource", b"BeginFont")
+                    ):
+                        assert value is not None
+                        resources = resource_list(keyword, value)
+                        resource = resources[0] if len(resources) > 0 else None
+                        open_resources.append((resource, record))
+                    elif len(open_resources) > 0 and keyword in (
+                        b"EndResource",
+                        b"EndFont",
+                    ):
+                        resource, resource_start = open_resources.pop()
+                        if resource is not None:
+                            ranges = self.resources.setdefault(resource, [])
+                            ranges.append(range(resource_start, next_record))
                     elif self.headerpos == 0 and (
                         keyword in size_keywords or keyword == b"DocumentPaperSizes"
                     ):
                         self.sizeheaders.append(record)
                     elif self.headerpos == 0 and keyword == b"Pages":
                         self.pagescmt = record
+                    elif self.headerpos == 0 and keyword == b"CreationDate":
+                        self.creationdate = record
                     elif self.headerpos == 0 and keyword == b"EndComments":
                         self.headerpos = next_record
                     elif keyword in [
                         b"BeginDocument",
                         b"BeginBinary",
-                        b"Begself.infile",
+                        b"BeginFile",
                     ]:
                         nesting += 1
                     elif keyword in [b"EndDocument", b"EndBinary", b"EndFile"]:
@@ -108,7 +381,12 @@ class PsReader:  # pylint: disable=too-many-instance-attributes,too-few-public-m
                         self.endsetup = record
                     elif nesting == 0 and keyword == b"BeginProlog":
                         self.headerpos = next_record
-                    elif nesting == 0 and buffer == b"%%BeginProcSet: PStoPS":
+                    elif (
+                        nesting == 0
+                        and keyword == b"BeginProcSet"
+                        and value is not None
+                        and value.startswith(b"PStoPS")
+                    ):
                         self.procset_pos = range(record, 0)
                     elif (
                         self.procset_pos.start > 0
@@ -116,14 +394,40 @@ class PsReader:  # pylint: disable=too-many-instance-attributes,too-few-public-m
                         and keyword == b"EndProcSet"
                     ):
                         self.procset_pos = range(self.procset_pos.start, next_record)
+                        # Spec procedures run up to the procset's final `end'
+                        if self.procset_spec_count > 0:
+                            self.procset_specs = range(specs_start, prev_record)
                     elif nesting == 0 and keyword in [b"Trailer", b"EOF"]:
                         break
             elif self.headerpos == 0:
                 self.headerpos = record
+            elif (
+                self.procset_pos.start > 0
+                and self.procset_pos.stop == 0
+                and buffer.startswith(b"/PStoPSspec")
+            ):
+                if self.procset_spec_count == 0:
+                    specs_start = record
+                self.procset_spec_count += 1
+            elif (
+                self.procset_pos.start > 0
+                and self.procset_pos.stop == 0
+                and buffer.startswith(b"/initclip")
+            ):
+                self.procset_initclip = True
+            prev_record = record
             record = next_record
 
-        # If paper size was not already set, and we found a possible size in
-        # the file, use it.
+        self.set_size(file_sizes)
+        self.num_pages = len(self.pageptr)
+        self.pageptr.append(record)
+        if self.endsetup == 0 or self.endsetup > self.pageptr[0]:
+            self.endsetup = self.pageptr[0]
+        self.indexed = True
+
+    # If paper size was not already set, and we found a possible size in the
+    # file, use it.
+    def set_size(self, file_sizes: Dict[bytes, Rectangle]) -> None:
         if self.size is None and len(file_sizes) > 0:
             for keyword in size_keywords:
                 file_size = file_sizes.get(keyword)
@@ -136,10 +440,30 @@ class PsReader:  # pylint: disable=too-many-instance-attributes,too-few-public-m
                     if keyword in (b"BoundingBox", b"HiResBoundingBox"):
                         self.size_guessed = True
                     break
-        self.num_pages = len(self.pageptr)
-        self.pageptr.append(record)
-        if self.endsetup == 0 or self.endsetup > self.pageptr[0]:
-            self.endsetup = self.pageptr[0]
+
+    # Record the resources listed by the comment `keyword' at `record', or by
+    # a continuation of it if `continuation', whose value is `value'.
+    def resource_comment(
+        self, keyword: bytes, record: int, value: bytes, continuation: bool
+    ) -> None:
+        if len(self.pageptr) > 0:
+            self.add_page_resources(keyword, value)
+        elif keyword in needed_resource_keywords:
+            if value.strip() != b"(atend)":
+                self.needed_resources.update(resource_list(keyword, value))
+        else:
+            if not continuation or len(self.supplied_comments) == 0:
+                self.supplied_comments.append((keyword, []))
+            self.supplied_comments[-1][1].append((record, value))
+
+    def add_page_resources(self, keyword: bytes, value: bytes) -> None:
+        if value.strip() == b"(atend)":
+            return
+        resources = self.page_resources[-1]
+        if resources is None:
+            resources = set()
+            self.page_resources[-1] = resources
+        resources.update(resource_list(keyword, value))
 
     # Return comment keyword and value if `line' is a DSC comment
     def comment(self, line: bytes) -> Union[Tuple[bytes, bytes], Tuple[None, None]]:
@@ -147,12 +471,30 @@ class PsReader:  # pylint: disable=too-many-instance-attributes,too-few-public-m
         return (m[1], m[2]) if m else (None, None)
 
 
-def document_reader(file: IO[bytes], file_type: str) -> Union[PdfReader, PsReader]:
+# Return a reader for `file', followed by the documents in `appended' as a
+# single document; see the append methods.
+def document_reader(
+    file: IO[bytes],
+    file_type: str,
+    appended: Sequence[Tuple[IO[bytes], str]] = (),
+) -> Union[PdfReader, PsReader]:
     constructor: Union[Type[PdfReader], Type[PsReader]]
     if file_type in (".ps", ".eps"):
         constructor = PsReader
     elif file_type == ".pdf":
         constructor = PdfReader
+    elif file_type == "":
+        die("unknown file type")
     else:
         die(f"incompatible file type `{file_type}'")
-    return constructor(file)
+    with span("read document", file_type=file_type):
+        doc = constructor(file)
+    for other_file, other_type in appended:
+        other = document_reader(other_file, other_type)
+        if isinstance(doc, PsReader) and isinstance(other, PsReader):
+            doc.append(other)
+        elif isinstance(doc, PdfReader) and isinstance(other, PdfReader):
+            doc.append(other)
+        else:
+            die("cannot append PDF and PostScript documents to each other")
+    return doc
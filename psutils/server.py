@@ -0,0 +1,230 @@
+"""
+PSUtils server.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+A request is a line of JSON giving a job, as in a batch manifest. If it
+has no input, it has an "input_size", and that many bytes of input follow
+it. The response is a line of JSON giving the job's result; if the job had
+no output, it has an "output_size", and that many bytes of output follow
+it. A connection carries one request and its response.
+
+The server handles a limited number of connections at once, leaving others
+waiting to be accepted, and refuses input larger than a limit.
+"""
+
+import concurrent.futures
+import json
+import multiprocessing
+import os
+import shutil
+import signal
+import socket
+import socketserver
+import tempfile
+import threading
+import time
+from concurrent.futures.process import BrokenProcessPool
+from dataclasses import asdict
+from typing import Any, Dict, Optional, Tuple
+
+from .batch import Job, JobResult, make_job, run_job
+from .warnings import die
+
+# The default limits on the connections handled at once, and on the size of
+# the input sent with a request
+MAX_CONNECTIONS = 64
+MAX_INPUT_SIZE = 256 * 1024 * 1024
+
+# The longest request line accepted
+MAX_REQUEST_SIZE = 1024 * 1024
+
+
+class RequestHandler(socketserver.StreamRequestHandler):
+    server: "Server"
+
+    # Seconds to wait for a client to send or receive data, so that a client
+    # that stops does not hold a connection
+    timeout = 60
+
+    def handle(self) -> None:
+        with tempfile.TemporaryDirectory(prefix="psutils-") as tmpdir:
+            try:
+                result, output = self.run_request(tmpdir)
+            except socket.timeout:
+                return
+            except (TypeError, ValueError, EOFError) as e:
+                result, output = JobResult("", "", 1, 0.0, f"invalid job: {e}\n"), None
+            fields: Dict[str, Any] = asdict(result)
+            if output is not None:
+                fields["output_size"] = (
+                    os.path.getsize(output) if os.path.exists(output) else 0
+                )
+            try:
+                self.wfile.write(json.dumps(fields).encode("utf-8") + b"\n")
+                if fields.get("output_size", 0) > 0:
+                    with open(output, "rb") as h:  # type: ignore
+                        shutil.copyfileobj(h, self.wfile)
+            except (BrokenPipeError, ConnectionResetError, socket.timeout):
+                pass  # The client went away; the job is done regardless
+
+    # Read a request, using `tmpdir' for input sent with it and output to
+    # send back, run it, and return its result and the name of the output
+    # file to send back, if any.
+    def run_request(self, tmpdir: str) -> Tuple[JobResult, Optional[str]]:
+        line = self.rfile.readline(MAX_REQUEST_SIZE + 1)
+        if len(line) > MAX_REQUEST_SIZE:
+            raise ValueError(f"request is longer than {MAX_REQUEST_SIZE} bytes")
+        fields = json.loads(line)
+        if not isinstance(fields, dict):
+            raise ValueError("job is not a JSON object")
+        input_size = fields.pop("input_size", None)
+        if input_size is not None:
+            if not isinstance(input_size, int) or input_size < 0:
+                raise ValueError("input_size must be a non-negative integer")
+            if input_size > self.server.max_input_size:
+                raise ValueError(
+                    f"input_size is more than {self.server.max_input_size} bytes"
+                )
+            fields["input"] = os.path.join(tmpdir, "input")
+            with open(fields["input"], "wb") as h:
+                while input_size > 0:
+                    data = self.rfile.read(min(input_size, 1 << 16))
+                    if len(data) == 0:
+                        raise EOFError("input ended early")
+                    h.write(data)
+                    input_size -= len(data)
+        output = None
+        if fields.get("output") is None:
+            output = fields["output"] = os.path.join(tmpdir, "output")
+        job = make_job("", fields)
+        return self.server.run_job(job), output
+
+
+class Server(socketserver.ThreadingUnixStreamServer):
+    """Run jobs sent to the Unix socket `path' with `jobs' worker processes,
+    or one per processor if None.
+
+    Each connection is handled in its own thread, which waits for a worker;
+    at most `jobs' jobs run at once, and at most `max_connections'
+    connections are handled at once. Input sent with a request may be at
+    most `max_input_size' bytes. Closing the server waits for the requests
+    being handled to finish.
+    """
+
+    daemon_threads = False
+    block_on_close = True
+
+    def __init__(
+        self,
+        path: str,
+        jobs: Optional[int],
+        max_connections: int = MAX_CONNECTIONS,
+        max_input_size: int = MAX_INPUT_SIZE,
+    ) -> None:
+        # Remove the socket left by a server that did not exit cleanly, but
+        # not that of one that is still running.
+        if os.path.exists(path):
+            with socket.socket(socket.AF_UNIX) as s:
+                try:
+                    s.connect(path)
+                    die(f"a server is already listening on {path}")
+                except ConnectionRefusedError:
+                    os.unlink(path)
+        super().__init__(path, RequestHandler)
+        # The server has several threads, from which it is not safe to fork,
+        # so workers are forked from a separate process that has already
+        # imported the commands.
+        self.jobs = jobs
+        self.context = multiprocessing.get_context("forkserver")
+        self.context.set_forkserver_preload(["psutils.batch"])
+        self.executor = concurrent.futures.ProcessPoolExecutor(jobs, self.context)
+        self.executor_lock = threading.Lock()
+        self.connections = threading.BoundedSemaphore(max_connections)
+        self.max_input_size = max_input_size
+
+    # Run `job' in a worker, and return its result. If a worker has died,
+    # the pool cannot be used again, and every job running in it fails;
+    # replace the pool, unless another request has already done so.
+    def run_job(self, job: Job) -> JobResult:
+        executor = self.executor
+        start = time.perf_counter()
+        try:
+            return executor.submit(run_job, job).result()
+        except BrokenProcessPool:
+            with self.executor_lock:
+                if self.executor is executor:
+                    self.executor = concurrent.futures.ProcessPoolExecutor(
+                        self.jobs, self.context
+                    )
+                    executor.shutdown(wait=False)
+            message = f"{job.command}: worker process died\n"
+            return JobResult(
+                job.id, job.command, 2, time.perf_counter() - start, message
+            )
+
+    # Wait for a free connection slot before handling a request; until then,
+    # further connections wait to be accepted. The slot is released by the
+    # thread that handles the request.
+    def process_request(self, request: Any, client_address: Any) -> None:
+        self.connections.acquire()  # pylint: disable=consider-using-with
+        try:
+            super().process_request(request, client_address)
+        except BaseException:
+            self.connections.release()
+            raise
+
+    def process_request_thread(self, request: Any, client_address: Any) -> None:
+        try:
+            super().process_request_thread(request, client_address)
+        finally:
+            self.connections.release()
+
+    def server_close(self) -> None:
+        super().server_close()
+        with self.executor_lock:
+            self.executor.shutdown()
+        os.unlink(self.server_address)  # type: ignore
+
+
+# Serve requests on `path' with `jobs' worker processes and the given
+# limits until SIGINT or SIGTERM, then finish the requests being handled and
+# exit.
+def serve(
+    path: str, jobs: Optional[int], max_connections: int, max_input_size: int
+) -> None:
+    server = Server(path, jobs, max_connections, max_input_size)
+    stop = threading.Event()
+    for signum in (signal.SIGINT, signal.SIGTERM):
+        signal.signal(signum, lambda _signum, _frame: stop.set())
+    thread = threading.Thread(target=server.serve_forever)
+    thread.start()
+    stop.wait()
+    server.shutdown()
+    thread.join()
+    server.server_close()
+
+
+# Send `job', a dict as in a batch manifest, to the server on `path', with
+# `data' as its input if it has none, and return the result, and the output
+# if the job had none.
+def send_request(
+    path: str, job: Dict[str, Any], data: Optional[bytes] = None
+) -> Tuple[Dict[str, Any], Optional[bytes]]:
+    job = dict(job)
+    if data is not None:
+        job["input_size"] = len(data)
+    with socket.socket(socket.AF_UNIX) as s:
+        s.connect(path)
+        with s.makefile("rwb") as stream:
+            stream.write(json.dumps(job).encode("utf-8") + b"\n")
+            if data is not None:
+                stream.write(data)
+            stream.flush()
+            s.shutdown(socket.SHUT_WR)
+            result = json.loads(stream.readline())
+            output = None
+            output_size = result.pop("output_size", None)
+            if output_size is not None:
+                output = stream.read(output_size)
+    return result, output
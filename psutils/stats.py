@@ -0,0 +1,144 @@
+"""
+PSUtils performance statistics.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+Statistics are collected for the job running in the current context, as
+diagnostics are; see collect_stats. Library users can collect them around
+any call, or set DocumentTransform.stats_hook.
+"""
+
+import json
+import resource
+import sys
+import threading
+import time
+from contextlib import contextmanager
+from contextvars import ContextVar
+from dataclasses import dataclass, field
+from typing import Any, Dict, Iterator, List, Optional
+
+from .trace import span
+from .warnings import diagnostics, die
+
+
+@dataclass
+class Stats:  # pylint: disable=too-many-instance-attributes
+    """Performance statistics of a job."""
+
+    # Seconds spent in each phase: open, hash (of the input, for the cache),
+    # scan (of PostScript DSC comments), load (of a PDF document), plan,
+    # write and finalize. Phases do not overlap: time spent in a phase
+    # entered during another counts only towards the inner one.
+    phases: Dict[str, float] = field(default_factory=dict)
+    bytes_read: int = 0
+    # Bytes written unchanged from the input, and bytes written otherwise
+    bytes_copied: int = 0
+    bytes_generated: int = 0
+    pages: int = 0
+    sheets: int = 0
+    # Sheets copied from the previous output, with --incremental
+    sheets_reused: int = 0
+    # The faster ways of working that were used, in the order first used
+    fast_paths: List[str] = field(default_factory=list)
+
+    def __post_init__(self) -> None:
+        self.start = time.perf_counter()
+        # Phases are timed only on the thread that made the Stats
+        self.thread = threading.get_ident()
+        self.phase_stack: List[str] = []
+        self.phase_start = self.start
+
+    # Phases are also traced, on any thread.
+    @contextmanager
+    def phase(self, name: str) -> Iterator[None]:
+        with span(name, "phase"):
+            if threading.get_ident() != self.thread:
+                yield
+                return
+            self.switch_phase()
+            self.phase_stack.append(name)
+            try:
+                yield
+            finally:
+                self.switch_phase()
+                self.phase_stack.pop()
+
+    # Add the time since the current phase was last timed to it.
+    def switch_phase(self) -> None:
+        now = time.perf_counter()
+        if len(self.phase_stack) > 0:
+            name = self.phase_stack[-1]
+            self.phases[name] = self.phases.get(name, 0.0) + now - self.phase_start
+        self.phase_start = now
+
+    def took(self, fast_path: str) -> None:
+        if fast_path not in self.fast_paths:
+            self.fast_paths.append(fast_path)
+
+    # Return the statistics as a JSON-compatible dict.
+    def report(self) -> Dict[str, Any]:
+        # ru_maxrss is in kilobytes on Linux, and bytes on macOS
+        scale = 1 if sys.platform == "darwin" else 1024
+        return {
+            "seconds": round(time.perf_counter() - self.start, 6),
+            "phases": {name: round(t, 6) for name, t in self.phases.items()},
+            "bytes": {
+                "read": self.bytes_read,
+                "copied": self.bytes_copied,
+                "generated": self.bytes_generated,
+            },
+            "pages": self.pages,
+            "sheets": self.sheets,
+            "sheets_reused": self.sheets_reused,
+            "peak_rss": resource.getrusage(resource.RUSAGE_SELF).ru_maxrss * scale,
+            "peak_rss_children": resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+            * scale,
+            "fast_paths": self.fast_paths,
+        }
+
+
+# The statistics being collected in the current context
+_stats: ContextVar[Optional[Stats]] = ContextVar("stats", default=None)
+
+
+# Return the statistics being collected in the current context, or, if none
+# are, a Stats that is discarded.
+def current_stats() -> Stats:
+    return _stats.get() or Stats()
+
+
+# Collect statistics in the current context, adding to those already being
+# collected, if any.
+@contextmanager
+def collect_stats() -> Iterator[Stats]:
+    stats = _stats.get()
+    if stats is not None:
+        yield stats
+        return
+    stats = Stats()
+    token = _stats.set(stats)
+    try:
+        yield stats
+    finally:
+        _stats.reset(token)
+
+
+# Collect statistics in the current context and, if `name' is not None,
+# write them as a line of JSON to the file `name', or to the diagnostics if
+# it is empty.
+@contextmanager
+def report_stats(name: Optional[str]) -> Iterator[None]:
+    with collect_stats() as stats:
+        yield
+    if name is None:
+        return
+    line = json.dumps({"command": diagnostics().prog, **stats.report()}) + "\n"
+    if name == "":
+        diagnostics().write(line)
+    else:
+        try:
+            with open(name, "w", encoding="utf-8") as h:
+                h.write(line)
+        except IOError:
+            die(f"cannot open statistics file {name}")
@@ -0,0 +1,115 @@
+"""
+PSUtils streamed PostScript output.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+When PostScript input can only be read forwards, as from a pipe, and its
+pages are wanted in order, each sheet is written as soon as its pages have
+been read, rather than after the whole input has been, and the input is
+released as it is used. As the number of sheets is not known until the end,
+it is given in the trailer.
+
+Input from a file is not streamed, so that its header can give the number of
+sheets. The pages selected from streamed input are not checked in advance,
+as that would mean holding all of it in memory, so a page range beyond its
+end is only found after the sheets before it have been written.
+"""
+
+import itertools
+from typing import TYPE_CHECKING, Iterator, List, Optional
+
+from .types import PageList, Plan, Range
+from .warnings import die
+
+if TYPE_CHECKING:
+    from .transformers import PsTransform
+
+
+# Whether the sheets of `transform' can be written as the input is read: the
+# input must be read forwards, and the pages wanted in order, none counted
+# from the end.
+def streamable(
+    transform: "PsTransform", pagerange: Optional[List[Range]], reverse: bool
+) -> bool:
+    if not transform.reader.streaming or reverse or transform.prune_resources:
+        return False
+    if len(transform.sources) > 1:
+        return False
+    if any(spec.reversed for page in transform.specs for spec in page):
+        return False
+    last = 0
+    for range_ in pagerange or []:
+        if range_.start == 0 and range_.end == 0:
+            continue
+        if range_.start < max(last, 1) or range_.end < range_.start:
+            return False
+        last = range_.end
+    return True
+
+
+# Yield the selected input pages of `transform', as PageList would, indexing
+# the input only as far as needed.
+def stream_page_list(
+    transform: "PsTransform", pagerange: Optional[List[Range]], odd: bool, even: bool
+) -> Iterator[int]:
+    reader = transform.reader
+    if pagerange is None:
+        pageno = 1
+        while reader.index_page(pageno - 1):
+            if PageList.selected(pageno, odd, even):
+                yield pageno - 1
+            pageno += 1
+        return
+    for range_ in pagerange:
+        for pageno in range(range_.start, range_.end + 1):
+            if pageno > 0 and not reader.index_page(pageno - 1):
+                die(f"page range {range_.text} is invalid", 2)
+            if PageList.selected(pageno, odd, even):
+                yield pageno - 1
+
+
+# Write sheets as soon as their pages have been read, releasing the input
+# before them, so that neither memory use nor the time to the first sheet
+# depends on the length of the input. Return the number of sheets.
+def write_sheets_streaming(
+    transform: "PsTransform",
+    pagerange: Optional[List[Range]],
+    odd: bool,
+    even: bool,
+    modulo: int,
+) -> int:
+    reader = transform.reader
+    transform.write_header(None)
+    selected = stream_page_list(transform, pagerange, odd, even)
+    sheets = 0
+    while True:
+        page_list = PageList(0, [], False, False, False)
+        page_list.pages = list(itertools.islice(selected, modulo))
+        if page_list.num_pages() == 0:
+            break
+        needed = [page for page in page_list.pages if page >= 0]
+        if len(needed) > 0:
+            reader.release(reader.pageptr[min(needed)])
+        plan = Plan(page_list, modulo, modulo, [])
+        for sheet in transform.plan_sheets(plan, 0, sheets):
+            transform.progress.sheet(sheet.pagelabel)
+            transform.write_sheet(plan, sheet)
+            sheets += 1
+    transform.streamed_sheets = sheets
+    return sheets
+
+
+# Start the trailer of the output of `transform' with the number of sheets,
+# replacing any number of pages given there.
+def write_trailer_pages(transform: "PsTransform", sheets: int) -> None:
+    reader = transform.reader
+    line = reader.infile.readline()
+    if reader.comment(line)[0] == b"Trailer":
+        transform.outfile.write(line)
+        line = reader.infile.readline()
+    else:
+        transform.write("%%Trailer")
+    transform.write(f"%%Pages: {sheets} 0")
+    while reader.comment(line)[0] == b"Pages":
+        line = reader.infile.readline()
+    transform.outfile.write(line)
@@ -0,0 +1,87 @@
+"""
+PSUtils tracing.
+Copyright (c) Reuben Thomas 2023.
+Released under the GPL version 3, or (at your option) any later version.
+
+A trace is a timeline of the spans of work done by a job, written in the
+Trace Event Format read by chrome://tracing and Perfetto. Set the
+environment variable PSUTILS_TRACE to a file name to trace a command, or
+use trace_to. Work done in worker processes, as with --jobs, appears as the
+single span of the process that waits for it.
+"""
+
+import json
+import os
+import threading
+import time
+from contextlib import contextmanager
+from contextvars import ContextVar
+from typing import Any, ContextManager, Dict, Iterator, List, Optional
+
+from .warnings import die
+
+# The environment variable that names the file to write a trace to
+TRACE_VARIABLE = "PSUTILS_TRACE"
+
+
+class Trace:  # pylint: disable=too-few-public-methods
+    def __init__(self) -> None:
+        self.events: List[Dict[str, Any]] = []
+        self.pid = os.getpid()
+
+
+# The trace being recorded in the current context
+_trace: ContextVar[Optional[Trace]] = ContextVar("trace", default=None)
+
+
+# Record the time taken by the enclosed code as a span called `name', in
+# the category `cat', with the arguments `args', if a trace is being
+# recorded.
+@contextmanager
+def span(name: str, cat: str = "psutils", **args: Any) -> Iterator[None]:
+    trace = _trace.get()
+    if trace is None:
+        yield
+        return
+    start = time.perf_counter_ns()
+    try:
+        yield
+    finally:
+        event = {
+            "name": name,
+            "cat": cat,
+            "ph": "X",
+            "ts": start // 1000,
+            "dur": (time.perf_counter_ns() - start) // 1000,
+            "pid": trace.pid,
+            "tid": threading.get_ident(),
+        }
+        if len(args) > 0:
+            event["args"] = args
+        trace.events.append(event)
+
+
+# Record a trace of the enclosed code, and write it to the file `name', if
+# it is not None and no trace is already being recorded.
+@contextmanager
+def trace_to(name: Optional[str]) -> Iterator[None]:
+    if name is None or _trace.get() is not None:
+        yield
+        return
+    trace = Trace()
+    token = _trace.set(trace)
+    try:
+        yield
+    finally:
+        _trace.reset(token)
+        try:
+            with open(name, "w", encoding="utf-8") as h:
+                json.dump({"traceEvents": trace.events}, h)
+        except IOError:
+            die(f"cannot open trace file {name}")
+
+
+# Record a trace of the enclosed code if the environment names a file to
+# write it to.
+def trace_command() -> ContextManager[None]:
+    return trace_to(os.environ.get(TRACE_VARIABLE) or None)
@@ -4,22 +4,68 @@ Copyright (c) Reuben Thomas 2023.
 Released under the GPL version 3, or (at your option) any later version.
 """
 
+import hashlib
 import io
-import sys
+import os
+import re
 import shutil
+import time
 from abc import ABC, abstractmethod
 from contextlib import contextmanager
-from typing import List, Optional, Union, Iterator, IO
-from warnings import warn
+from typing import (
+    Any,
+    Callable,
+    Dict,
+    List,
+    Optional,
+    Set,
+    Tuple,
+    Union,
+    Iterator,
+    IO,
+)
 
 from pypdf import PdfWriter, Transformation
 from pypdf.annotations import PolyLine
 
 from .argparse import parserange
-from .io import setup_input_and_output
+from .cache import source_date
+from .incremental import (
+    Incremental,
+    current_incremental,
+    hash_pdf_object,
+    write_sheets_incremental,
+)
+from .io import append_file, append_range, setup_input_and_output
+from .parallel import (
+    CAN_GRAFT,
+    SegmentWriter,
+    write_sheets_parallel,
+    write_sheets_split,
+)
+from .pipelined import write_sheets_pipelined
+from .progress import Progress
+from .psresources import (
+    PROCSET,
+    PROCSET_INITCLIP,
+    supplied_comments,
+    unused_resources,
+)
 from .readers import PsReader, PdfReader, document_reader
-from .types import Rectangle, Range, Offset, PageSpec, PageList
-from .warnings import die
+from .stats import Stats, collect_stats, current_stats
+from .streaming import streamable, write_sheets_streaming, write_trailer_pages
+from .trace import span
+from .types import (
+    Rectangle,
+    Range,
+    Offset,
+    OutputOptions,
+    PageSpec,
+    PageList,
+    Plan,
+    Sheet,
+)
+from .warnings import die, warn
 
 
 def page_index_to_page_number(
@@ -28,17 +74,37 @@ def page_index_to_page_number(
     return (maxpage - pagebase - modulo if spec.reversed else pagebase) + spec.pageno
 
 
-class DocumentTransform(ABC):
+class DocumentTransform(ABC):  # pylint: disable=too-many-instance-attributes
     def __init__(self) -> None:
         self.in_size: Optional[Rectangle]
         self.specs: List[List[PageSpec]]
+        self.outfile: IO[bytes]
+        # Input pages already read by read_pages
+        self.page_data: Dict[int, bytes] = {}
+        # The statistics of the job, and a function to give them to when
+        # transform_pages has finished
+        self.stats = current_stats()
+        self.stats_hook: Optional[Callable[[Stats], None]] = None
+        self.progress = Progress(False, False, self.stats)
+        # The sheets of the previous output, with --incremental
+        self.incremental = current_incremental()
+
+    # Whether join_segment is implemented, so that sheets can be written by
+    # several processes.
+    parallel = False
+
+    # Whether read_pages is implemented, so that reading the input, building
+    # sheets and writing the output can overlap.
+    pipelined = False
 
     @abstractmethod
     def pages(self) -> int:
         pass
 
+    # Write the header of the output; without a plan, the number of sheets
+    # is not yet known.
     @abstractmethod
-    def write_header(self, maxpage: int, modulo: int) -> None:
+    def write_header(self, plan: Optional[Plan]) -> None:
         pass
 
     @abstractmethod
@@ -61,19 +127,67 @@ class DocumentTransform(ABC):
     def finalize(self) -> None:
         pass
 
-    def transform_pages(
+    # Write the given sheets to the file `segment'; run in a worker process.
+    def write_segment(self, plan: Plan, sheets: List[Sheet], segment: str) -> None:
+        with open(segment, "wb") as outfile:
+            self.outfile = outfile
+            for sheet in sheets:
+                self.write_sheet(plan, sheet)
+
+    # Append a segment written by write_segment to the output. Bytes written
+    # by workers are counted as generated.
+    def join_segment(self, segment: str) -> None:
+        self.stats.bytes_generated += os.path.getsize(segment)
+        with span("join segment"):
+            append_file(segment, self.outfile)
+
+    # Return the source of the given input pages, indexed by page number, for
+    # write_page to use.
+    @abstractmethod
+    def read_pages(self, pages: List[int]) -> Dict[int, bytes]:
+        pass
+
+    # Return what the sheets depend on other than their place in the output
+    # and the pages on them, for reusing sheets with --incremental.
+    def sheet_context(self) -> str:
+        raise NotImplementedError
+
+    # Return a hash of the input page `pagenum', for --incremental.
+    def page_digest(self, pagenum: int) -> str:
+        raise NotImplementedError
+
+    # Write the sheet `sheet' of the previous output, found in its index.
+    def reuse_sheet(self, incremental: Incremental, sheet: Dict[str, Any]) -> None:
+        raise NotImplementedError
+
+    # Return the sheets for the pages of `plan' from `pagebase', numbered
+    # after `outputpage'.
+    def plan_sheets(self, plan: Plan, pagebase: int, outputpage: int) -> List[Sheet]:
+        sheets: List[Sheet] = []
+        for page in self.specs:
+            # Construct the page label from the input page numbers
+            pagelabels = []
+            for spec in page:
+                n = plan.page_list.real_page(
+                    page_index_to_page_number(spec, plan.maxpage, plan.modulo, pagebase)
+                )
+                pagelabels.append(str(n + 1) if n >= 0 else "*")
+            pagelabel = ",".join(pagelabels)
+            sheets.append(
+                Sheet(outputpage + len(sheets) + 1, pagelabel, page, pagebase)
+            )
+        return sheets
+
+    # Return the plan for putting the selected pages, `modulo' at a time, on
+    # sheets.
+    def plan_pages(
         self,
         pagerange: Optional[List[Range]],
-        flipping: bool,
-        reverse: bool,
         odd: bool,
         even: bool,
+        reverse: bool,
         modulo: int,
-        verbose: bool,
-    ) -> None:
-        if self.in_size is None and flipping:
-            die("input page size must be set when flipping the page")
-
+    ) -> Plan:
         # Page spec routines for page rearrangement
         def abs_page(n: int) -> int:
             if n < 0:
@@ -81,96 +195,162 @@ class DocumentTransform(ABC):
                 n = max(n, 1)
             return n
 
-        def transform_pages(
-            pagerange: Optional[List[Range]], odd: bool, even: bool, reverse: bool
-        ) -> None:
-            outputpage = 0
-            # If no page range given, select all pages
-            if pagerange is None:
-                pagerange = parserange("1-_1")
-
-            # Normalize end-relative pageranges
-            for range_ in pagerange:
-                range_.start = abs_page(range_.start)
-                range_.end = abs_page(range_.end)
-
-            # Get list of pages
-            page_list = PageList(self.pages(), pagerange, reverse, odd, even)
-
-            # Calculate highest page number output (including any blanks)
-            maxpage = (
-                page_list.num_pages()
-                + (modulo - page_list.num_pages() % modulo) % modulo
+        # If no page range given, select all pages
+        if pagerange is None:
+            pagerange = parserange("1-_1")
+
+        # Normalize end-relative pageranges
+        for range_ in pagerange:
+            range_.start = abs_page(range_.start)
+            range_.end = abs_page(range_.end)
+
+        # Get list of pages
+        page_list = PageList(self.pages(), pagerange, reverse, odd, even)
+
+        # Calculate highest page number output (including any blanks)
+        maxpage = (
+            page_list.num_pages() + (modulo - page_list.num_pages() % modulo) % modulo
+        )
+
+        # Rearrange pages
+        plan = Plan(page_list, maxpage, modulo, [])
+        pagebase = 0
+        while pagebase < maxpage:
+            plan.sheets.extend(self.plan_sheets(plan, pagebase, len(plan.sheets)))
+            pagebase += modulo
+        return plan
+
+    # Prepare to read the input pages in the order given by `plan'.
+    def plan_reads(self, plan: Plan) -> None:
+        pass
+
+    # Note that worker processes will read the input at the same time.
+    def share_input(self) -> None:
+        pass
+
+    def write_sheet(self, plan: Plan, sheet: Sheet) -> None:
+        with span("sheet", page=sheet.pagelabel, sheet=sheet.outputpage):
+            self.write_page_comment(sheet.pagelabel, sheet.outputpage)
+            self.write_page(
+                plan.page_list,
+                sheet.outputpage,
+                sheet.page_specs,
+                plan.maxpage,
+                plan.modulo,
+                sheet.pagebase,
             )
 
-            # Rearrange pages
-            self.write_header(maxpage, modulo)
-            pagebase = 0
-            while pagebase < maxpage:
-                for page in self.specs:
-                    # Construct the page label from the input page numbers
-                    pagelabels = []
-                    for spec in page:
-                        n = page_list.real_page(
-                            page_index_to_page_number(spec, maxpage, modulo, pagebase)
-                        )
-                        pagelabels.append(str(n + 1) if n >= 0 else "*")
-                    pagelabel = ",".join(pagelabels)
-                    outputpage += 1
-                    self.write_page_comment(pagelabel, outputpage)
-                    if verbose:
-                        sys.stderr.write(f"[{pagelabel}] ")
-                    self.write_page(
-                        page_list, outputpage, page, maxpage, modulo, pagebase
-                    )
-
-                pagebase += modulo
+    # Return the input pages placed on `sheet', in the order of its page
+    # specs, with None for a blank page.
+    def sheet_sources(self, plan: Plan, sheet: Sheet) -> List[Optional[int]]:
+        sources: List[Optional[int]] = []
+        for spec in sheet.page_specs:
+            page_number = page_index_to_page_number(
+                spec, plan.maxpage, plan.modulo, sheet.pagebase
+            )
+            real_page = plan.page_list.real_page(page_number)
+            if (
+                page_number < plan.page_list.num_pages()
+                and 0 <= real_page < self.pages()
+            ):
+                sources.append(real_page)
+            else:
+                sources.append(None)
+        return sources
 
-            self.finalize()
-            if verbose:
-                print(f"\nWrote {outputpage} pages", file=sys.stderr)
+    def transform_pages(
+        self,
+        pagerange: Optional[List[Range]],
+        flipping: bool,
+        reverse: bool,
+        odd: bool,
+        even: bool,
+        modulo: int,
+        options: OutputOptions,
+    ) -> None:
+        with collect_stats() as stats:
+            self.stats = stats
+            self.progress = Progress(options.verbose, options.page_labels, stats)
+            self.write_pages(pagerange, flipping, reverse, odd, even, modulo, options)
+            stats.pages = self.pages()
+        if self.stats_hook is not None:
+            self.stats_hook(stats)
+
+    def write_pages(
+        self,
+        pagerange: Optional[List[Range]],
+        flipping: bool,
+        reverse: bool,
+        odd: bool,
+        even: bool,
+        modulo: int,
+        options: OutputOptions,
+    ) -> None:
+        if self.in_size is None and flipping:
+            die("input page size must be set when flipping the page")
 
         # Output the pages
-        transform_pages(pagerange, odd, even, reverse)
+        stats = self.stats
+        if options.split > 0:
+            with stats.phase("plan"):
+                plan = self.plan_pages(pagerange, odd, even, reverse, modulo)
+            self.progress.total = len(plan.sheets)
+            stats.took("split")
+            with stats.phase("write"):
+                write_sheets_split(self, plan, options.split, options.outfile_name)
+            stats.sheets = len(plan.sheets)
+            self.progress.done(len(plan.sheets))
+            return
+        if options.jobs > 1 and not self.parallel:
+            warn("--jobs is not used for PDF output with this version of pypdf")
+        if options.pipeline and not self.pipelined:
+            warn("--pipeline is only used for PostScript output")
+        sheets = self.write_sheets(pagerange, odd, even, reverse, modulo, options)
+        with stats.phase("finalize"):
+            self.finalize()
+        stats.sheets = sheets
+        self.progress.done(sheets)
+
+    # Write the header and the sheets of the selected pages, and return how
+    # many sheets there were.
+    def write_sheets(
+        self,
+        pagerange: Optional[List[Range]],
+        odd: bool,
+        even: bool,
+        reverse: bool,
+        modulo: int,
+        options: OutputOptions,
+    ) -> int:
+        stats = self.stats
+        with stats.phase("plan"):
+            plan = self.plan_pages(pagerange, odd, even, reverse, modulo)
+            if options.jobs > 1 and self.parallel:
+                self.share_input()
+            self.plan_reads(plan)
+        self.progress.total = len(plan.sheets)
+        with stats.phase("write"):
+            self.write_header(plan)
+            if self.incremental is not None:
+                stats.took("incremental")
+                write_sheets_incremental(self, plan, self.incremental)
+            elif options.jobs > 1 and self.parallel and len(plan.sheets) > 1:
+                stats.took("parallel")
+                write_sheets_parallel(self, plan, options.jobs)
+            elif options.pipeline and self.pipelined:
+                stats.took("pipelined")
+                write_sheets_pipelined(self, plan)
+            else:
+                for sheet in plan.sheets:
+                    self.progress.sheet(sheet.pagelabel)
+                    self.write_sheet(plan, sheet)
+        return len(plan.sheets)
 
 
 # FIXME: Extract PsWriter.
 class PsTransform(DocumentTransform):  # pylint: disable=too-many-instance-attributes
-    # PStoPS procset
-    # Wrap showpage, erasepage and copypage in our own versions.
-    # Nullify paper size operators.
-    procset = """userdict begin
-[/showpage/erasepage/copypage]{dup where{pop dup load
- type/operatortype eq{ /PStoPSenablepage cvx 1 index
- load 1 array astore cvx {} bind /ifelse cvx 4 array
- astore cvx def}{pop}ifelse}{pop}ifelse}forall
- /PStoPSenablepage true def
-[/letter/legal/executivepage/a4/a4small/b5/com10envelope
- /monarchenvelope/c5envelope/dlenvelope/lettersmall/note
- /folio/quarto/a5]{dup where{dup wcheck{exch{}put}
- {pop{}def}ifelse}{pop}ifelse}forall
-/setpagedevice {pop}bind 1 index where{dup wcheck{3 1 roll put}
- {pop def}ifelse}{def}ifelse
-/PStoPSmatrix matrix currentmatrix def
-/PStoPSxform matrix def/PStoPSclip{clippath}def
-/defaultmatrix{PStoPSmatrix exch PStoPSxform exch concatmatrix}bind def
-/initmatrix{matrix defaultmatrix setmatrix}bind def
-/initclip[{matrix currentmatrix PStoPSmatrix setmatrix
- [{currentpoint}stopped{$error/newerror false put{newpath}}
- {/newpath cvx 3 1 roll/moveto cvx 4 array astore cvx}ifelse]
- {[/newpath cvx{/moveto cvx}{/lineto cvx}
- {/curveto cvx}{/closepath cvx}pathforall]cvx exch pop}
- stopped{$error/errorname get/invalidaccess eq{cleartomark
- $error/newerror false put cvx exec}{stop}ifelse}if}bind aload pop
- /initclip dup load dup type dup/operatortype eq{pop exch pop}
- {dup/arraytype eq exch/packedarraytype eq or
-  {dup xcheck{exch pop aload pop}{pop cvx}ifelse}
-  {pop cvx}ifelse}ifelse
- {newpath PStoPSclip clip newpath exec setmatrix} bind aload pop]cvx def
-/initgraphics{initmatrix newpath initclip 1 setlinewidth
- 0 setlinecap 0 setlinejoin []0 setdash 0 setgray
- 10 setmiterlimit}bind def
-end"""
+    parallel = True
+    pipelined = True
 
     def __init__(
         self,
@@ -181,6 +361,8 @@ end"""
         specs: List[List[PageSpec]],
         draw: float,
         in_size_guessed: bool,
+        light_procset: bool = False,
+        prune_resources: bool = False,
     ):
         super().__init__()
         self.reader = reader
@@ -188,6 +370,13 @@ end"""
         self.draw = draw
         self.specs = specs
         self.in_size_guessed = in_size_guessed
+        # Pages from an earlier PStoPS run whose procset redefined initclip
+        # may call it, so need the full procset
+        self.light_procset = light_procset and not reader.procset_initclip
+        self.prune_resources = prune_resources
+        # The number of sheets, if it is given at the end of the output
+        # rather than in its header
+        self.streamed_sheets: Optional[int] = None
 
         self.use_procset = any(
             len(page) > 1 or page[0].has_transform() for page in specs
@@ -201,13 +390,132 @@ end"""
                 in_size = size
         self.in_size = in_size
 
+        # Compile each distinct page transformation into a procedure, so that
+        # each placed page needs only a single call. Number them after any
+        # procedures from an earlier PStoPS run, which we keep.
+        self.spec_procs: Dict[str, str] = {}
+        for page in specs:
+            for spec in page:
+                if spec.has_transform():
+                    setup = self.spec_setup(spec)
+                    if setup not in self.spec_procs:
+                        n = reader.procset_spec_count + len(self.spec_procs)
+                        self.spec_procs[setup] = f"PStoPSspec{n}"
+
+        # The documents whose pages we use, and the code to put before and
+        # after each of their pages
+        self.sources = [reader, *reader.appended]
+        prolog = reader.prolog()
+        self.source_wrappers = [(b"", b"")]
+        for source in reader.appended:
+            self.source_wrappers.append(source.page_wrapper(prolog))
+
     def pages(self) -> int:
-        return self.reader.num_pages
+        return self.reader.total_pages()
+
+    # Return the index in self.sources of the document containing page
+    # `pagenum', and the page's number in it.
+    def page_source(self, pagenum: int) -> Tuple[int, int]:
+        source = 0
+        while (
+            source < len(self.sources) - 1 and pagenum >= self.sources[source].num_pages
+        ):
+            pagenum -= self.sources[source].num_pages
+            source += 1
+        return source, pagenum
+
+    # Return the PostScript that transforms the coordinate system for `spec'
+    def spec_setup(self, spec: PageSpec) -> str:
+        lines = ["PStoPSmatrix setmatrix"]
+        if spec.off != Offset(0.0, 0.0):
+            lines.append(f"{spec.off.x:f} {spec.off.y:f} translate")
+        if spec.rotate != 0:
+            lines.append(f"{spec.rotate % 360} rotate")
+        if spec.hflip == 1:
+            assert self.in_size is not None
+            lines.append(f"[ -1 0 0 1 {self.in_size.width * spec.scale:g} 0 ] concat")
+        if spec.vflip == 1:
+            assert self.in_size is not None
+            lines.append(f"[ 1 0 0 -1 0 {self.in_size.height * spec.scale:g} ] concat")
+        if spec.scale != 1.0:
+            lines.append(f"{spec.scale:f} dup scale")
+        lines.append("userdict/PStoPSmatrix matrix currentmatrix put")
+        if self.in_size is not None:
+            w, h = self.in_size.width, self.in_size.height
+            clip = (
+                "newpath PStoPSclip clip newpath" if self.light_procset else "initclip"
+            )
+            lines.append(
+                f"""userdict/PStoPSclip{{0 0 moveto
+ {w:f} 0 rlineto 0 {h:f} rlineto {-w:f} 0 rlineto
+ closepath}}put {clip}"""
+            )
+            if self.draw > 0:
+                lines.append(
+                    f"gsave clippath 0 setgray {self.draw} setlinewidth stroke grestore"
+                )
+        return "\n".join(lines)
 
-    def write_header(self, maxpage: int, modulo: int) -> None:
+    def write_procset(self) -> None:
+        if self.light_procset:
+            self.write("%%BeginProcSet: PStoPS-light 1 16")
+            self.write(PROCSET)
+        else:
+            self.write("%%BeginProcSet: PStoPS 1 16")
+            self.write(PROCSET)
+            self.write(PROCSET_INITCLIP)
+        if self.reader.procset_specs:
+            # Keep the spec procedures that the input's pages call, unbinding
+            # any that an earlier version bound
+            here = self.reader.infile.tell()
+            self.reader.infile.seek(self.reader.procset_specs.start)
+            specs = self.reader.infile.read(len(self.reader.procset_specs))
+            self.outfile.write(
+                re.sub(b"}bind def$", b"}def", specs, flags=re.MULTILINE)
+            )
+            self.reader.infile.seek(here)
+        # The procedures are not bound, so that, like the code of the pages,
+        # they use any operators that the document redefines
+        for setup, name in self.spec_procs.items():
+            self.write(f"/{name}{{{setup}}}def")
+        self.write("end")
+        self.write("%%EndProcSet")
+
+    # If `plan' is None, the pages are being streamed, so the number of pages
+    # is given in the trailer.
+    def write_header(self, plan: Optional[Plan]) -> None:
         # FIXME: doesn't cope properly with loaded definitions
         ignorelist = [] if self.size is None else self.reader.sizeheaders
+        pruned: Set[Tuple[bytes, bytes]] = set()
+        skip: List[range] = []
+        if plan is not None and self.prune_resources:
+            resources = []
+            for page in plan.page_list.pages:
+                if 0 <= page < self.pages():
+                    source, pagenum = self.page_source(page)
+                    resources.append(self.sources[source].page_resources[pagenum])
+            pruned, skip = unused_resources(self.reader, resources)
         self.reader.infile.seek(0)
+
+        # Give the creation date, and the lists of supplied resources without
+        # those we prune, after the first line, replacing any in the header
+        comments = []
+        date = source_date()
+        if date is not None:
+            if self.reader.creationdate > 0:
+                ignorelist = sorted([*ignorelist, self.reader.creationdate])
+            comments.append(f"%%CreationDate: {time.asctime(date)}".encode("utf-8"))
+        if len(pruned) > 0:
+            records, supplied = supplied_comments(self.reader, pruned)
+            ignorelist = sorted([*ignorelist, *records])
+            comments.extend(supplied)
+        if len(comments) > 0:
+            line = self.reader.infile.readline()
+            self.outfile.write(line)
+            self.stats.bytes_copied += len(line)
+            for comment in comments:
+                self.outfile.write(comment + b"\n")
+                self.stats.bytes_generated += len(comment) + 1
         if self.reader.pagescmt:
             self.fcopy(self.reader.pagescmt, ignorelist)
             try:
@@ -223,19 +531,21 @@ end"""
                 self.write(
                     f"%%BoundingBox: 0 0 {int(self.size.width)} {int(self.size.height)}"
                 )
-            pagesperspec = len(self.specs)
-            self.write(f"%%Pages: {int(maxpage / modulo) * pagesperspec} 0")
+            if plan is None or self.streamed_sheets is not None:
+                self.write("%%Pages: (atend)")
+            else:
+                self.write(f"%%Pages: {len(plan.sheets)} 0")
         self.fcopy(self.reader.headerpos, ignorelist)
         if self.use_procset:
-            self.write(f"%%BeginProcSet: PStoPS 1 15\n{self.procset}")
-            self.write("%%EndProcSet")
+            self.write_procset()
 
-        # Write prologue to end of setup section, skipping our procset if present
-        # and we're outputting it (this allows us to upgrade our procset)
+        # Write prologue to end of setup section, skipping any PStoPS procset
+        # if we're outputting ours (this replaces rather than stacks procsets),
+        # and any resources that we are pruning
         if self.reader.procset_pos and self.use_procset:
-            self.fcopy(self.reader.procset_pos.start, [])
-            self.reader.infile.seek(self.reader.procset_pos.stop)
-        self.fcopy(self.reader.endsetup, [])
+            skip.append(self.reader.procset_pos)
+        skip.sort(key=lambda r: r.start)
+        self.fcopy_skipping(self.reader.endsetup, skip)
 
         # Save transformation from original to current matrix
         if not self.reader.procset_pos and self.use_procset:
@@ -246,10 +556,39 @@ end"""
             )
 
         # Write from end of setup to start of pages
-        self.fcopy(self.reader.pageptr[0], [])
+        self.fcopy_skipping(self.reader.pageptr[0], skip)
+
+    # Sheets of input that can only be read forwards whose pages are wanted
+    # in order are written as the input is read, unless the whole plan is
+    # needed. Their number goes in the trailer however they are written, so
+    # that it does not depend on the options.
+    def write_sheets(
+        self,
+        pagerange: Optional[List[Range]],
+        odd: bool,
+        even: bool,
+        reverse: bool,
+        modulo: int,
+        options: OutputOptions,
+    ) -> int:
+        if not streamable(self, pagerange, reverse):
+            return super().write_sheets(pagerange, odd, even, reverse, modulo, options)
+        self.streamed_sheets = 0
+        if options.jobs == 1 and not options.pipeline and self.incremental is None:
+            self.stats.took("streaming")
+            with self.stats.phase("write"):
+                sheets = write_sheets_streaming(self, pagerange, odd, even, modulo)
+        else:
+            sheets = super().write_sheets(
+                pagerange, odd, even, reverse, modulo, options
+            )
+        self.streamed_sheets = sheets
+        return sheets
 
     def write(self, text: str) -> None:
-        self.outfile.write((text + "\n").encode("utf-8"))
+        data = (text + "\n").encode("utf-8")
+        self.outfile.write(data)
+        self.stats.bytes_generated += len(data)
 
     def write_page_comment(self, pagelabel: str, outputpage: int) -> None:
         self.write(f"%%Page: ({pagelabel}) {outputpage}")
@@ -267,83 +606,111 @@ end"""
         for spec in page_specs:
             page_number = page_index_to_page_number(spec, maxpage, modulo, pagebase)
             real_page = page_list.real_page(page_number)
-            if page_number < page_list.num_pages() and 0 <= real_page < self.pages():
-                # Seek the page
-                pagenum = real_page
-                self.reader.infile.seek(self.reader.pageptr[pagenum])
-                try:
-                    line = self.reader.infile.readline()
-                    keyword, _ = self.reader.comment(line)
-                    assert keyword == b"Page"
-                except IOError:
-                    die(f"I/O error seeking page {pagenum}", 2)
-            if self.use_procset:
-                self.write("userdict/PStoPSsaved save put")
-            if spec.has_transform():
-                self.write("PStoPSmatrix setmatrix")
-                if spec.off != Offset(0.0, 0.0):
-                    self.write(f"{spec.off.x:f} {spec.off.y:f} translate")
-                if spec.rotate != 0:
-                    self.write(f"{spec.rotate % 360} rotate")
-                if spec.hflip == 1:
-                    assert self.in_size is not None
-                    self.write(
-                        f"[ -1 0 0 1 {self.in_size.width * spec.scale:g} 0 ] concat"
-                    )
-                if spec.vflip == 1:
-                    assert self.in_size is not None
-                    self.write(
-                        f"[ 1 0 0 -1 0 {self.in_size.height * spec.scale:g} ] concat"
-                    )
-                if spec.scale != 1.0:
-                    self.write(f"{spec.scale:f} dup scale")
-                self.write("userdict/PStoPSmatrix matrix currentmatrix put")
-                if self.in_size is not None:
-                    w, h = self.in_size.width, self.in_size.height
-                    self.write(
-                        f"""userdict/PStoPSclip{{0 0 moveto
- {w:f} 0 rlineto 0 {h:f} rlineto {-w:f} 0 rlineto
- closepath}}put initclip"""
-                    )
-                    if self.draw > 0:
-                        self.write(
-                            f"gsave clippath 0 setgray {self.draw} setlinewidth stroke grestore"
-                        )
-            if spec_page_number < len(page_specs) - 1:
-                self.write("/PStoPSenablepage false def")
-            if (
-                self.reader.procset_pos
-                and page_number < page_list.num_pages()
-                and real_page < self.pages()
-            ):
-                # Search for page setup
-                while True:
-                    try:
-                        line = self.reader.infile.readline()
-                    except IOError:
-                        die(f"I/O error reading page setup {outputpage}", 2)
-                    if line.startswith(b"PStoPSxform"):
-                        break
-                    try:
-                        self.write(line.decode())
-                    except IOError:
-                        die(f"I/O error writing page setup {outputpage}", 2)
-            if not self.reader.procset_pos and self.use_procset:
-                self.write("PStoPSxform concat")
-            if page_number < page_list.num_pages() and 0 <= real_page < self.pages():
-                # Write the body of a page
-                self.fcopy(self.reader.pageptr[real_page + 1], [])
-            else:
-                self.write("showpage")
-            if self.use_procset:
-                self.write("PStoPSsaved restore")
-            spec_page_number += 1
+            with span("page", page=page_number + 1):
+                if self.use_procset:
+                    self.write("userdict/PStoPSsaved save put")
+                if spec.has_transform():
+                    self.write(self.spec_procs[self.spec_setup(spec)])
+                if spec_page_number < len(page_specs) - 1:
+                    self.write("/PStoPSenablepage false def")
+                # Pages that were already transformed by PStoPS carry their own
+                # `PStoPSxform concat', so only add it to untransformed pages.
+                source = self.reader
+                exists = self.reader.has_page(real_page)
+                if exists:
+                    source = self.sources[self.page_source(real_page)[0]]
+                if not source.procset_pos and self.use_procset:
+                    self.write("PStoPSxform concat")
+                if page_number < page_list.num_pages() and exists:
+                    # Write the body of a page
+                    body = self.page_data.get(real_page)
+                    if body is None:
+                        with span("read page"):
+                            body = self.read_page(real_page)
+                    self.outfile.write(body)
+                    self.stats.bytes_copied += len(body)
+                else:
+                    self.write("showpage")
+                if self.use_procset:
+                    self.write("PStoPSsaved restore")
+                spec_page_number += 1
+
+    def plan_reads(self, plan: Plan) -> None:
+        pages: List[List[int]] = [[] for _ in self.sources]
+        for sheet in plan.sheets:
+            for page in self.sheet_sources(plan, sheet):
+                if page is not None:
+                    source, pagenum = self.page_source(page)
+                    pages[source].append(pagenum)
+        for reader, source_pages in zip(self.sources, pages):
+            reader.plan_reads(source_pages)
+            if reader.read_ahead is not None:
+                self.stats.took("read-ahead")
+
+    def share_input(self) -> None:
+        self.reader.share()
+
+    # Return the body of page `pagenum', without its %%Page comment.
+    def read_page(self, pagenum: int) -> bytes:
+        source, source_pagenum = self.page_source(pagenum)
+        before, after = self.source_wrappers[source]
+        return before + self.sources[source].read_page(source_pagenum) + after
+
+    def read_pages(self, pages: List[int]) -> Dict[int, bytes]:
+        return {pagenum: self.read_page(pagenum) for pagenum in pages}
+
+    def sheet_context(self) -> str:
+        return repr(
+            [
+                type(self).__name__,
+                self.specs,
+                self.size,
+                self.in_size,
+                self.draw,
+                self.light_procset,
+                self.use_procset,
+                self.spec_procs,
+                bool(self.reader.procset_pos),
+            ]
+        )
+
+    # Whether a page was transformed by PStoPS changes how it is placed.
+    def page_digest(self, pagenum: int) -> str:
+        source = self.sources[self.page_source(pagenum)[0]]
+        digest = hashlib.sha256(b"PStoPS" if source.procset_pos else b"")
+        digest.update(self.read_page(pagenum))
+        return digest.hexdigest()
+
+    def reuse_sheet(self, incremental: Incremental, sheet: Dict[str, Any]) -> None:
+        self.stats.bytes_copied += append_range(
+            incremental.previous_output(), sheet["start"], sheet["stop"], self.outfile
+        )
 
     def finalize(self) -> None:
+        # Find the trailer, releasing any pages we skip
+        while not self.reader.indexed:
+            self.reader.index_page(self.reader.num_pages)
+            self.reader.release(self.reader.pageptr[-1])
+
         # Write trailer
-        self.reader.infile.seek(self.reader.pageptr[self.pages()])
-        shutil.copyfileobj(self.reader.infile, self.outfile)  # type: ignore
-        self.outfile.flush()
+        self.reader.infile.seek(self.reader.pageptr[self.reader.num_pages])
+        if self.streamed_sheets is not None and self.reader.pagescmt:
+            write_trailer_pages(self, self.streamed_sheets)
+        start = self.reader.infile.tell()
+        with span("copy trailer"):
+            shutil.copyfileobj(self.reader.infile, self.outfile)  # type: ignore
+        self.stats.bytes_copied += self.reader.infile.tell() - start
+        with span("flush"):
+            self.outfile.flush()
+
+    # Copy input file from current position up to new position to output file,
+    # omitting the byte ranges in `skip', which must be sorted.
+    def fcopy_skipping(self, upto: int, skip: List[range]) -> None:
+        for r in skip:
+            if self.reader.infile.tell() <= r.start and r.stop <= upto:
+                self.fcopy(r.start, [])
+                self.reader.infile.seek(r.stop)
+        self.fcopy(upto, [])
 
     # Copy input file from current position up to new position to output file,
     # ignoring the lines starting at something ignorelist points to.
@@ -363,12 +730,17 @@ end"""
             here = self.reader.infile.tell()
 
         try:
-            self.outfile.write(self.reader.infile.read(upto - here))
+            with span("fcopy"):
+                data = self.reader.infile.read(upto - here)
+                self.outfile.write(data)
+            self.stats.bytes_copied += len(data)
         except IOError:
             die("I/O error", 2)
 
 
-class PdfTransform(DocumentTransform):
+class PdfTransform(DocumentTransform):  # pylint: disable=too-many-instance-attributes
+    parallel = CAN_GRAFT
+
     def __init__(
         self,
         reader: PdfReader,
@@ -381,9 +753,12 @@ class PdfTransform(DocumentTransform):
         super().__init__()
         self.outfile = outfile
         self.reader = reader
-        self.writer = PdfWriter(self.outfile)
+        self.input_pages = reader.all_pages()
+        self.writer = PdfWriter()
         self.draw = draw
         self.specs = specs
+        # Hashes of the input's objects, for --incremental
+        self.object_digests: Dict[Tuple[int, int], bytes] = {}
 
         if in_size is None:
             in_size = reader.size
@@ -394,14 +769,29 @@ class PdfTransform(DocumentTransform):
         self.in_size = in_size
 
     def pages(self) -> int:
-        return len(self.reader.pages)
+        return len(self.input_pages)
 
-    def write_header(self, maxpage: int, modulo: int) -> None:
-        pass
+    # Start a new document, as --split may write several in turn.
+    def write_header(self, plan: Optional[Plan]) -> None:
+        self.writer = PdfWriter()
 
     def write_page_comment(self, pagelabel: str, outputpage: int) -> None:
         pass
 
+    # Write the given sheets as a document of their own, recording which
+    # input objects it copies, so that join_segment can share them.
+    def write_segment(self, plan: Plan, sheets: List[Sheet], segment: str) -> None:
+        self.writer = SegmentWriter(self.reader.documents(), True)
+        for sheet in sheets:
+            self.write_sheet(plan, sheet)
+        self.writer.write_segment(segment)
+
+    def join_segment(self, segment: str) -> None:
+        if not isinstance(self.writer, SegmentWriter):
+            self.writer = SegmentWriter(self.reader.documents())
+        with span("join segment"):
+            self.writer.join_segment(segment)
+
     def write_page(
         self,
         page_list: PageList,
@@ -420,18 +810,20 @@ class PdfTransform(DocumentTransform):
             len(page_specs) == 1
             and not page_specs[0].has_transform()
             and page_number < page_list.num_pages()
-            and 0 <= real_page < len(self.reader.pages)
+            and 0 <= real_page < len(self.input_pages)
             and self.draw == 0
             and (
                 self.in_size.width is None
                 or (
-                    self.in_size.width == self.reader.pages[real_page].mediabox.width
+                    self.in_size.width == self.input_pages[real_page].mediabox.width
                     and self.in_size.height
-                    == self.reader.pages[real_page].mediabox.height
+                    == self.input_pages[real_page].mediabox.height
                 )
             )
         ):
-            self.writer.add_page(self.reader.pages[real_page])
+            with span("add_page", page=real_page + 1):
+                self.writer.add_page(self.input_pages[real_page])
+            self.stats.took("pdf-page-copy")
         else:
             # Add a blank page of the correct size to the end of the document
             outpdf_page = self.writer.add_blank_page(self.size.width, self.size.height)
@@ -439,7 +831,7 @@ class PdfTransform(DocumentTransform):
                 page_number = page_index_to_page_number(spec, maxpage, modulo, pagebase)
                 real_page = page_list.real_page(page_number)
                 if page_number < page_list.num_pages() and 0 <= real_page < len(
-                    self.reader.pages
+                    self.input_pages
                 ):
                     # Calculate input page transformation
                     t = Transformation()
@@ -458,9 +850,12 @@ class PdfTransform(DocumentTransform):
                     if spec.off != Offset(0.0, 0.0):
                         t = t.translate(spec.off.x, spec.off.y)
                     # Merge input page into the output document
-                    outpdf_page.merge_transformed_page(self.reader.pages[real_page], t)
+                    with span("merge_transformed_page", page=real_page + 1):
+                        outpdf_page.merge_transformed_page(
+                            self.input_pages[real_page], t
+                        )
                     if self.draw > 0:  # FIXME: draw the line at the requested width
-                        mediabox = self.reader.pages[real_page].mediabox
+                        mediabox = self.input_pages[real_page].mediabox
                         line = PolyLine(
                             vertices=[
                                 (
@@ -484,13 +879,49 @@ class PdfTransform(DocumentTransform):
                         )
                         self.writer.add_annotation(outpdf_page, line)
 
+    # Pages are not read ahead: write_page takes them from the reader.
+    def read_pages(self, pages: List[int]) -> Dict[int, bytes]:
+        return {}
+
+    def sheet_context(self) -> str:
+        return repr(
+            [type(self).__name__, self.specs, self.size, self.in_size, self.draw]
+        )
+
+    def page_digest(self, pagenum: int) -> str:
+        digest = hashlib.sha256()
+        hash_pdf_object(digest, self.input_pages[pagenum], self.object_digests, set())
+        return digest.hexdigest()
+
+    # Graft the page of the previous output into the new one.
+    def reuse_sheet(self, incremental: Incremental, sheet: Dict[str, Any]) -> None:
+        previous = incremental.previous_document().pages[sheet["page"]]
+        with span("add_page"):
+            self.writer.add_page(previous)
+
     def finalize(self) -> None:
-        # PyPDF seeks, so write to a buffer first in case outfile is stdout.
-        buf = io.BytesIO()
-        self.writer.write(buf)
-        buf.seek(0)
-        self.outfile.write(buf.read())
-        self.outfile.flush()
+        # pypdf writes no /ID unless encrypting, so the output depends only
+        # on the input and the creation date, if any
+        date = source_date()
+        if date is not None:
+            self.writer.add_metadata(
+                {"/CreationDate": time.strftime("D:%Y%m%d%H%M%SZ", date)}
+            )
+
+        # PyPDF needs the position in the output, so write to a buffer first
+        # unless outfile is a seekable file that is empty, which is not the
+        # case for standard output. Write the buffer out without copying it.
+        with span("write PDF"):
+            if self.outfile.seekable() and self.outfile.tell() == 0:
+                self.writer.write(self.outfile)
+                self.stats.bytes_generated += self.outfile.tell()
+            else:
+                buf = io.BytesIO()
+                self.writer.write(buf)
+                self.stats.bytes_generated += buf.tell()
+                self.outfile.write(buf.getbuffer())
+        with span("flush"):
+            self.outfile.flush()
 
 
 def document_transform(
@@ -501,23 +932,39 @@ def document_transform(
     specs: List[List[PageSpec]],
     draw: float,
     in_size_guessed: bool,
+    light_procset: bool = False,
+    prune_resources: bool = False,
 ) -> Union[PdfTransform, PsTransform]:
     if isinstance(indoc, PsReader):
-        return PsTransform(indoc, outfile, size, in_size, specs, draw, in_size_guessed)
+        return PsTransform(
+            indoc,
+            outfile,
+            size,
+            in_size,
+            specs,
+            draw,
+            in_size_guessed,
+            light_procset,
+            prune_resources,
+        )
     if isinstance(indoc, PdfReader):
+        if prune_resources:
+            warn("--prune-resources is only used for PostScript input")
         return PdfTransform(indoc, outfile, size, in_size, specs, draw)
     die("unknown document type")
 
 
 @contextmanager
 def file_transform(
-    infile_name: str,
-    outfile_name: str,
+    infile_name: Optional[str],
+    outfile_name: Optional[str],
     size: Optional[Rectangle],
     in_size: Optional[Rectangle],
     specs: List[List[PageSpec]],
     draw: float,
     in_size_guessed: bool,
+    light_procset: bool = False,
+    prune_resources: bool = False,
 ) -> Iterator[Union[PdfTransform, PsTransform]]:
     with setup_input_and_output(infile_name, outfile_name) as (
         infile,
@@ -526,5 +973,13 @@ def file_transform(
     ):
         doc = document_reader(infile, file_type)
         yield document_transform(
-            doc, outfile, size, in_size, specs, draw, in_size_guessed
+            doc,
+            outfile,
+            size,
+            in_size,
+            specs,
+            draw,
+            in_size_guessed,
+            light_procset,
+            prune_resources,
         )
@@ -4,8 +4,9 @@ Copyright (c) Reuben Thomas 2023.
 Released under the GPL version 3, or (at your option) any later version.
 """
 
+import argparse
 from dataclasses import dataclass
-from typing import List, NamedTuple
+from typing import List, NamedTuple, Optional
 
 from .warnings import die
 
@@ -65,14 +66,19 @@ class PageList:
             while range_.end - currentpg != -inc:
                 if currentpg > total_pages:
                     die(f"page range {range_.text} is invalid", 2)
-                if not (odd and (not even) and currentpg % 2 == 0) and not (
-                    even and not odd and currentpg % 2 == 1
-                ):
+                if self.selected(currentpg, odd, even):
                     self.pages.append(currentpg - 1)
                 currentpg += inc
         if reverse:
             self.pages.reverse()
 
+    # Whether page number `pageno' is selected by `odd' and `even'
+    @staticmethod
+    def selected(pageno: int, odd: bool, even: bool) -> bool:
+        return not (odd and (not even) and pageno % 2 == 0) and not (
+            even and not odd and pageno % 2 == 1
+        )
+
     # Returns -1 for an inserted blank page (page number '_')
     def real_page(self, pagenum: int) -> int:
         try:
@@ -82,3 +88,44 @@ class PageList:
 
     def num_pages(self) -> int:
         return len(self.pages)
+
+
+# An output page, and the input pages placed on it
+@dataclass
+class Sheet:
+    outputpage: int
+    pagelabel: str
+    page_specs: List[PageSpec]
+    pagebase: int
+
+
+# The complete arrangement of input pages on to output pages
+@dataclass
+class Plan:
+    page_list: PageList
+    maxpage: int
+    modulo: int
+    sheets: List[Sheet]
+
+
+# How the sheets of a transformation are written, as given by the options of
+# a command
+@dataclass
+class OutputOptions:
+    verbose: bool = False
+    jobs: int = 1
+    pipeline: bool = False
+    split: int = 0
+    outfile_name: Optional[str] = None
+    page_labels: bool = False
+
+    @classmethod
+    def from_args(cls, args: argparse.Namespace) -> "OutputOptions":
+        return cls(
+            args.verbose,
+            args.jobs,
+            args.pipeline,
+            args.split,
+            args.outfile,
+            args.page_labels,
+        )
@@ -4,26 +4,84 @@ Copyright (c) Reuben Thomas 2023.
 Released under the GPL version 3, or (at your option) any later version.
 """
 
+import os
 import sys
-from warnings import warn
-from typing import Callable, Optional, Union, Type, NoReturn, TextIO
+from contextlib import contextmanager
+from contextvars import ContextVar
+from dataclasses import dataclass
+from typing import IO, Iterator, Optional, NoReturn
+
+
+@dataclass
+class Diagnostics:
+    """Where a job's warnings and progress messages go: `file', or standard
+    error if None. Warnings are prefixed with `prog'."""
+
+    prog: str
+    file: Optional[IO[str]] = None
+
+    def write(self, text: str) -> None:
+        (self.file or sys.stderr).write(text)
+
+    def isatty(self) -> bool:
+        return (self.file or sys.stderr).isatty()
+
+    def warn(self, msg: str) -> None:
+        self.write(f"\n{self.prog}: {msg}\n")
+
+
+# The diagnostics of the job running in the current context
+_diagnostics: ContextVar[Optional[Diagnostics]] = ContextVar(
+    "diagnostics", default=None
+)
+
+
+# Return the current diagnostics; by default, messages go to standard error,
+# named after the program, as argparse names it.
+def diagnostics() -> Diagnostics:
+    return _diagnostics.get() or Diagnostics(os.path.basename(sys.argv[0]))
+
+
+# Send messages in the current context to `sink'.
+@contextmanager
+def report_to(sink: Diagnostics) -> Iterator[None]:
+    token = _diagnostics.set(sink)
+    try:
+        yield
+    finally:
+        _diagnostics.reset(token)
 
 
 # Error messages
-def simple_warning(prog: str) -> Callable[..., None]:
-    def _warning(  # pylint: disable=too-many-arguments
-        message: Union[Warning, str],
-        category: Type[Warning],  # pylint: disable=unused-argument
-        filename: str,  # pylint: disable=unused-argument
-        lineno: int,  # pylint: disable=unused-argument
-        file: Optional[TextIO] = sys.stderr,
-        line: Optional[str] = None,  # pylint: disable=unused-argument
-    ) -> None:
-        print(f"\n{prog}: {message}", file=file or sys.stderr)
+def warn(msg: str) -> None:
+    diagnostics().warn(msg)
+
+
+class PsutilsError(Exception):
+    """An error that stops a command, raised instead of exiting when the
+    command is run through the library API."""
+
+    def __init__(self, msg: str, code: Optional[int] = 1) -> None:
+        super().__init__(msg)
+        self.code = code
+
+
+# Whether die raises PsutilsError rather than exiting
+_raise_errors: ContextVar[bool] = ContextVar("raise_errors", default=False)
+
 
-    return _warning
+# Make die raise PsutilsError in the current context.
+@contextmanager
+def raise_errors() -> Iterator[None]:
+    token = _raise_errors.set(True)
+    try:
+        yield
+    finally:
+        _raise_errors.reset(token)
 
 
 def die(msg: str, code: Optional[int] = 1) -> NoReturn:
+    if _raise_errors.get():
+        raise PsutilsError(msg, code)
     warn(msg)
     sys.exit(code)
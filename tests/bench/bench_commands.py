@@ -0,0 +1,295 @@
+"""Measure the time and peak memory of each command on large synthetic
+documents, and how they grow with the number of pages.
+
+Usage: python tests/bench/bench_commands.py [OPTION...]
+
+Each command is run in a fresh process on PostScript and PDF documents of
+each size, several times, keeping the best time and memory use. A command
+whose time or memory grows faster than the number of pages is flagged. The
+results can be saved with --output, and compared with saved results with
+--baseline; the exit status is 1 if anything was flagged.
+"""
+
+import argparse
+import importlib.metadata
+import json
+import math
+import os
+import platform
+import subprocess
+import sys
+import time
+from dataclasses import dataclass
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from typing import Any, Dict, List, Optional, Tuple
+
+sys.path.insert(0, str(Path(__file__).parent.parent))
+# pylint: disable=wrong-import-position
+from synthetic import Spec, write_document  # noqa: E402
+
+ROOT = Path(__file__).parent.parent.parent
+
+# The exponent of growth with the number of pages above which time or
+# memory use is flagged as super-linear
+SUPERLINEAR = 1.3
+
+# Growth is only measured between runs that take at least this many
+# seconds, or this many bytes of memory, more than starting up
+MIN_SECONDS = 0.05
+MIN_BYTES = 4 * 1024 * 1024
+
+
+@dataclass
+class Command:
+    name: str
+    # The arguments, in which {in} and {out} are replaced by the input and
+    # output file names; without {out}, standard output is the output
+    args: List[str]
+    formats: Tuple[str, ...] = ("ps", "pdf")
+
+
+COMMANDS = [
+    Command("psselect", ["-q", "-e", "{in}", "{out}"]),
+    Command("psbook", ["-q", "-s16", "{in}", "{out}"]),
+    Command(
+        "pstops",
+        [
+            "-q",
+            "-pa4",
+            "--specs=2:0L@0.7(21cm,0)+1L@0.7(21cm,14.85cm)",
+            "{in}",
+            "{out}",
+        ],
+    ),
+    Command("psnup", ["-q", "-4", "-pa4", "{in}", "{out}"]),
+    Command("psresize", ["-q", "-pletter", "{in}", "{out}"]),
+    Command("pspipe", ["-q", "psselect -e | psbook -s8 | psnup -2", "{in}", "{out}"]),
+    Command("psjoin", ["{in}", "{in}"]),
+    Command("extractres", ["-q", "{in}", "{out}"], ("ps",)),
+    Command("includeres", ["-q", "{in}", "{out}"], ("ps",)),
+]
+
+
+@dataclass
+class Result:
+    seconds: float
+    # Peak resident set size in bytes
+    peak_rss: int
+
+
+def environment() -> Dict[str, str]:
+    env = dict(os.environ)
+    env["PYTHONPATH"] = os.pathsep.join(
+        [str(ROOT), *filter(None, env.get("PYTHONPATH", "").split(os.pathsep))]
+    )
+    return env
+
+
+# Run `command' with `args' in `cwd', and return its time and peak memory.
+def run(command: str, args: List[str], cwd: Path, stdout: Optional[Path]) -> Result:
+    with open(stdout or os.devnull, "wb") as out, open(cwd / "stderr", "wb") as err:
+        start = time.perf_counter()
+        process = subprocess.Popen(  # pylint: disable=consider-using-with
+            [sys.executable, "-m", f"psutils.command.{command}", *args],
+            stdout=out,
+            stderr=err,
+            cwd=cwd,
+            env=environment(),
+        )
+        _, status, usage = os.wait4(process.pid, 0)
+        seconds = time.perf_counter() - start
+    process.returncode = os.waitstatus_to_exitcode(status)
+    if process.returncode != 0:
+        sys.stderr.write((cwd / "stderr").read_text(errors="replace"))
+        raise RuntimeError(f"{command} {' '.join(args)} failed")
+    # ru_maxrss is in kilobytes on Linux, and bytes on macOS
+    scale = 1 if sys.platform == "darwin" else 1024
+    return Result(seconds, usage.ru_maxrss * scale)
+
+
+# Run `command' `n' times, and return its least time and memory use.
+def best(n: int, *args: Any) -> Result:
+    runs = [run(*args) for _ in range(n)]
+    return Result(min(r.seconds for r in runs), min(r.peak_rss for r in runs))
+
+
+def make_input(tmpdir: Path, file_format: str, pages: int) -> Path:
+    path = tmpdir / f"input-{pages}.{file_format}"
+    with open(path, "wb") as file:
+        write_document(file, Spec(pages), file_format)
+    return path
+
+
+# Return the exponent of growth from `a' to `b' over the page counts `m' to
+# `n', or None if there is too little to measure.
+def exponent(a: float, b: float, m: int, n: int, least: float) -> Optional[float]:
+    if a < least or b < least:
+        return None
+    return math.log(b / a) / math.log(n / m)
+
+
+# Return a bar of `width' characters, proportional to `value' / `largest'.
+def bar(value: float, largest: float, width: int = 30) -> str:
+    return "#" * max(1, round(width * value / largest)) if largest > 0 else ""
+
+
+def benchmark(args: argparse.Namespace) -> Dict[str, Any]:
+    commands = [c for c in COMMANDS if args.commands is None or c.name in args.commands]
+    results: List[Dict[str, Any]] = []
+    with TemporaryDirectory(prefix="psutils-bench-") as tmp:
+        tmpdir = Path(tmp)
+        startup = best(args.repeat, "psselect", ["--version"], tmpdir, None)
+        for file_format in args.formats:
+            inputs = {n: make_input(tmpdir, file_format, n) for n in args.pages}
+            for command in commands:
+                if file_format not in command.formats:
+                    continue
+                for pages, infile in inputs.items():
+                    outfile = tmpdir / f"output.{file_format}"
+                    argv = [
+                        a.replace("{in}", str(infile)).replace("{out}", str(outfile))
+                        for a in command.args
+                    ]
+                    stdout = None if "{out}" in command.args else outfile
+                    result = best(args.repeat, command.name, argv, tmpdir, stdout)
+                    results.append(
+                        {
+                            "command": command.name,
+                            "format": file_format,
+                            "pages": pages,
+                            "input_size": infile.stat().st_size,
+                            "seconds": round(result.seconds, 4),
+                            "peak_rss": result.peak_rss,
+                        }
+                    )
+                    print(
+                        f"{command.name} {file_format} {pages} pages: "
+                        + f"{result.seconds:.2f}s, {result.peak_rss / 2**20:.0f} MiB",
+                        file=sys.stderr,
+                    )
+    return {
+        "python": platform.python_version(),
+        "psutils": importlib.metadata.version("pspdfutils"),
+        "startup": {"seconds": round(startup.seconds, 4), "peak_rss": startup.peak_rss},
+        "results": results,
+    }
+
+
+# Flag results that grow faster than linearly, and return the messages.
+def check_scaling(report: Dict[str, Any]) -> List[str]:
+    startup = report["startup"]
+    series: Dict[Tuple[str, str], List[Dict[str, Any]]] = {}
+    for r in report["results"]:
+        series.setdefault((r["command"], r["format"]), []).append(r)
+    flags = []
+    for (command, file_format), rs in series.items():
+        rs.sort(key=lambda r: r["pages"])
+        print(f"\n{command} {file_format}: time per 1000 pages")
+        per_page = [1000 * (r["seconds"] - startup["seconds"]) / r["pages"] for r in rs]
+        for r, t in zip(rs, per_page):
+            t = max(t, 0)
+            print(f"  {r['pages']:>8} {t:8.3f}s {bar(t, max(per_page))}")
+        for a, b in zip(rs, rs[1:]):
+            for key, least in (("seconds", MIN_SECONDS), ("peak_rss", MIN_BYTES)):
+                e = exponent(
+                    a[key] - startup[key],
+                    b[key] - startup[key],
+                    a["pages"],
+                    b["pages"],
+                    least,
+                )
+                if e is not None and e > SUPERLINEAR:
+                    flags.append(
+                        f"{command} {file_format}: {key} grows as pages^{e:.2f} "
+                        + f"from {a['pages']} to {b['pages']} pages"
+                    )
+    return flags
+
+
+# Compare `report' with `baseline', and return the regressions.
+def compare(
+    report: Dict[str, Any], baseline: Dict[str, Any], tolerance: float
+) -> List[str]:
+    old = {(r["command"], r["format"], r["pages"]): r for r in baseline["results"]}
+    flags = []
+    print(f"\nCompared with the baseline (psutils {baseline.get('psutils')}):")
+    for r in report["results"]:
+        base = old.get((r["command"], r["format"], r["pages"]))
+        if base is None:
+            continue
+        ratios = {key: r[key] / max(base[key], 1e-9) for key in ("seconds", "peak_rss")}
+        print(
+            f"  {r['command']} {r['format']} {r['pages']}: "
+            + f"time {ratios['seconds']:.2f}x, memory {ratios['peak_rss']:.2f}x"
+        )
+        for key, ratio in ratios.items():
+            if ratio > 1 + tolerance:
+                flags.append(
+                    f"{r['command']} {r['format']} {r['pages']} pages: {key} "
+                    + f"{base[key]} -> {r[key]} ({ratio:.2f}x)"
+                )
+    return flags
+
+
+def get_parser() -> argparse.ArgumentParser:
+    parser = argparse.ArgumentParser(
+        description="Benchmark the PSUtils commands on synthetic documents."
+    )
+    parser.add_argument(
+        "--pages",
+        type=lambda s: [int(n) for n in s.split(",")],
+        default=[1000, 10000, 100000],
+        help="comma-separated page counts [default: 1000,10000,100000]",
+    )
+    parser.add_argument(
+        "--formats",
+        type=lambda s: s.split(","),
+        default=["ps", "pdf"],
+        help="comma-separated formats [default: ps,pdf]",
+    )
+    parser.add_argument(
+        "--commands",
+        type=lambda s: s.split(","),
+        help="comma-separated commands to run [default: all]",
+    )
+    parser.add_argument(
+        "--repeat",
+        type=int,
+        default=3,
+        help="run each command this many times, and keep the best [default: 3]",
+    )
+    parser.add_argument("--output", metavar="FILE", help="write the results to FILE")
+    parser.add_argument(
+        "--baseline", metavar="FILE", help="compare with the results in FILE"
+    )
+    parser.add_argument(
+        "--tolerance",
+        type=float,
+        default=0.25,
+        help="fraction by which time or memory may exceed the baseline "
+        + "[default: 0.25]",
+    )
+    return parser
+
+
+def main(argv: List[str]) -> None:
+    args = get_parser().parse_args(argv)
+    report = benchmark(args)
+    if args.output is not None:
+        with open(args.output, "w", encoding="utf-8") as h:
+            json.dump(report, h, indent=2)
+            h.write("\n")
+    flags = check_scaling(report)
+    if args.baseline is not None:
+        with open(args.baseline, encoding="utf-8") as h:
+            flags += compare(report, json.load(h), args.tolerance)
+    if len(flags) > 0:
+        print("\nFlagged:")
+        for flag in flags:
+            print(f"  {flag}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,43 @@
+"""Time psnup on a large PostScript document and PDF with and without --jobs.
+
+Usage: python tests/bench/bench_jobs.py [PAGES [JOBS]]
+"""
+
+import os
+import sys
+import time
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from typing import List
+
+sys.path.insert(0, str(Path(__file__).parent.parent))
+# pylint: disable=wrong-import-position
+from synthetic import Spec, write_document  # noqa: E402
+
+from psutils.command.psnup import psnup  # noqa: E402
+
+
+def run(args: List[str]) -> float:
+    start = time.perf_counter()
+    psnup(args)
+    return time.perf_counter() - start
+
+
+def main(argv: List[str]) -> None:
+    pages = int(argv[0]) if len(argv) > 0 else 2000
+    jobs = int(argv[1]) if len(argv) > 1 else (os.cpu_count() or 1)
+    for file_format in ("ps", "pdf"):
+        with TemporaryDirectory() as tmpdir:
+            infile = Path(tmpdir) / f"input.{file_format}"
+            with open(infile, "wb") as file:
+                write_document(file, Spec(pages, font=True), file_format)
+            outfile = str(Path(tmpdir) / f"output.{file_format}")
+            serial = run(["-q", "-4", "-pa4", str(infile), outfile])
+            parallel = run(["-q", "-4", "-pa4", f"--jobs={jobs}", str(infile), outfile])
+        print(f"{pages} pages of {file_format.upper()}, psnup -4: ", end="")
+        print(f"serial {serial:.2f}s, --jobs={jobs} {parallel:.2f}s", end="")
+        print(f", speedup {serial / parallel:.2f}x")
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,222 @@
+"""Check that the peak memory use of each command stays within a budget
+proportional to the size of its input.
+
+Usage: python tests/bench/bench_memory.py [OPTION...]
+
+Each command is run in a fresh process on synthetic PostScript and PDF
+documents with an image on each page, so that the input is large compared
+with the memory used by Python itself. Two peaks are measured: the Python
+heap, with tracemalloc, and the growth in resident set size, by sampling.
+A full extra copy of the input or output adds about one input size to one
+or both, which exceeds the budgets below; the exit status is then 1.
+"""
+
+import argparse
+import importlib
+import json
+import os
+import resource
+import subprocess
+import sys
+import threading
+import time
+import tracemalloc
+from dataclasses import dataclass
+from pathlib import Path
+from tempfile import TemporaryDirectory
+from typing import Dict, List, Optional, Tuple
+
+# pylint: disable=wrong-import-position
+from bench_commands import COMMANDS, environment  # noqa: E402
+
+sys.path.insert(0, str(Path(__file__).parent.parent))
+from synthetic import Spec, write_document  # noqa: E402
+
+# How often to sample the resident set size, in seconds
+SAMPLE_INTERVAL = 0.005
+
+# Memory used whatever the size of the input, in bytes
+HEAP_SLACK = 2 * 1024 * 1024
+RSS_SLACK = 8 * 1024 * 1024
+
+
+@dataclass
+class Budget:
+    # The most memory that may be used, as multiples of the input size, on
+    # the Python heap and in the growth of the resident set size
+    heap: float
+    rss: float
+
+
+# The default budget, and those of commands that need more. PostScript is
+# copied a line at a time, except by extractres, which holds the body of the
+# document while it collects resources; pypdf reads the whole of a PDF into
+# its object model, and psjoin also holds the objects of every input.
+DEFAULT_BUDGET = Budget(0.5, 1.75)
+BUDGETS: Dict[Tuple[str, str], Budget] = {
+    ("extractres", "ps"): Budget(2.25, 5.0),
+    ("psselect", "pdf"): Budget(2.25, 5.0),
+    ("psbook", "pdf"): Budget(3.5, 7.25),
+    ("pstops", "pdf"): Budget(3.75, 7.75),
+    ("psnup", "pdf"): Budget(3.25, 7.0),
+    ("psresize", "pdf"): Budget(4.25, 9.75),
+    ("pspipe", "pdf"): Budget(2.5, 5.75),
+    ("psjoin", "pdf"): Budget(8.25, 13.5),
+}
+
+
+# Return the resident set size of this process in bytes, or None if it
+# cannot be found.
+def current_rss() -> Optional[int]:
+    try:
+        with open("/proc/self/statm", encoding="ascii") as h:
+            return int(h.read().split()[1]) * os.sysconf("SC_PAGE_SIZE")
+    except (OSError, ValueError, IndexError):
+        return None
+
+
+def peak_rss() -> int:
+    # ru_maxrss is in kilobytes on Linux, and bytes on macOS
+    scale = 1 if sys.platform == "darwin" else 1024
+    return resource.getrusage(resource.RUSAGE_SELF).ru_maxrss * scale
+
+
+class RssSampler(threading.Thread):
+    """Record the peak resident set size until stopped."""
+
+    def __init__(self) -> None:
+        super().__init__(daemon=True)
+        self.peak = 0
+        self.stopped = threading.Event()
+
+    def run(self) -> None:
+        while not self.stopped.is_set():
+            self.peak = max(self.peak, current_rss() or 0)
+            time.sleep(SAMPLE_INTERVAL)
+
+    def stop(self) -> None:
+        self.stopped.set()
+        self.join()
+
+
+# Run `command' with `argv' in this process, and write its peak memory use
+# as JSON to the file `result'.
+def measure(result: str, command: str, argv: List[str]) -> None:
+    function = getattr(importlib.import_module(f"psutils.command.{command}"), command)
+    start_rss = current_rss() or peak_rss()
+    sampler = RssSampler()
+    sampler.start()
+    tracemalloc.start()
+    try:
+        function(argv)
+    except SystemExit as e:
+        if e.code not in (None, 0):
+            raise
+    heap = tracemalloc.get_traced_memory()[1]
+    tracemalloc.stop()
+    sampler.stop()
+    rss = max(sampler.peak, current_rss() or 0)
+    if rss == 0:
+        rss = peak_rss()
+    with open(result, "w", encoding="utf-8") as h:
+        json.dump({"heap": heap, "rss": rss - start_rss}, h)
+
+
+def check(args: argparse.Namespace) -> List[str]:
+    commands = [c for c in COMMANDS if args.commands is None or c.name in args.commands]
+    failures = []
+    with TemporaryDirectory(prefix="psutils-memory-") as tmp:
+        tmpdir = Path(tmp)
+        for file_format in args.formats:
+            infile = tmpdir / f"input.{file_format}"
+            with open(infile, "wb") as h:
+                write_document(h, Spec(args.pages, image=args.image), file_format)
+            size = infile.stat().st_size
+            print(f"{file_format}: {args.pages} pages, {size / 2**20:.1f} MiB")
+            for command in commands:
+                if file_format not in command.formats:
+                    continue
+                outfile = tmpdir / f"output.{file_format}"
+                argv = [
+                    a.replace("{in}", str(infile)).replace("{out}", str(outfile))
+                    for a in command.args
+                ]
+                result = tmpdir / "result.json"
+                with open(
+                    outfile if "{out}" not in command.args else os.devnull, "wb"
+                ) as out:
+                    subprocess.run(
+                        [
+                            sys.executable,
+                            __file__,
+                            "--measure",
+                            str(result),
+                            command.name,
+                            *argv,
+                        ],
+                        stdout=out,
+                        cwd=tmpdir,
+                        env=environment(),
+                        check=True,
+                    )
+                used = json.loads(result.read_text(encoding="utf-8"))
+                budget = BUDGETS.get((command.name, file_format), DEFAULT_BUDGET)
+                limits = {
+                    "heap": budget.heap * size + HEAP_SLACK,
+                    "rss": budget.rss * size + RSS_SLACK,
+                }
+                print(
+                    f"  {command.name}: heap {used['heap'] / size:.2f}x "
+                    + f"(budget {budget.heap}x), "
+                    + f"RSS {used['rss'] / size:.2f}x (budget {budget.rss}x)"
+                )
+                for key, limit in limits.items():
+                    if used[key] > limit:
+                        failures.append(
+                            f"{command.name} {file_format}: {key} {used[key]} bytes "
+                            + f"exceeds budget of {limit:.0f} bytes"
+                        )
+    return failures
+
+
+def get_parser() -> argparse.ArgumentParser:
+    parser = argparse.ArgumentParser(
+        description="Check the memory use of the PSUtils commands."
+    )
+    parser.add_argument(
+        "--pages", type=int, default=2000, help="number of pages [default: 2000]"
+    )
+    parser.add_argument(
+        "--image",
+        type=int,
+        default=48,
+        help="size in pixels of the image on each page [default: 48]",
+    )
+    parser.add_argument(
+        "--formats",
+        type=lambda s: s.split(","),
+        default=["ps", "pdf"],
+        help="comma-separated formats [default: ps,pdf]",
+    )
+    parser.add_argument(
+        "--commands",
+        type=lambda s: s.split(","),
+        help="comma-separated commands to run [default: all]",
+    )
+    return parser
+
+
+def main(argv: List[str]) -> None:
+    if len(argv) > 0 and argv[0] == "--measure":
+        measure(argv[1], argv[2], argv[3:])
+        return
+    failures = check(get_parser().parse_args(argv))
+    if len(failures) > 0:
+        print("\nOver budget:")
+        for failure in failures:
+            print(f"  {failure}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
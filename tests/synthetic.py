@@ -0,0 +1,365 @@
+"""Write synthetic PostScript and PDF documents of any length.
+
+The documents are written as they are generated, so they can be larger
+than memory, and need no external tools. What they contain is given by a
+Spec; see there.
+
+Usage: python tests/synthetic.py [OPTION...] OUTFILE
+"""
+
+import argparse
+import sys
+from dataclasses import dataclass
+from typing import IO, Dict, List, Sequence, Tuple
+
+# A4, in points
+PAPER = (595, 842)
+
+# One of each byte value, from which binary data is made
+BYTES = bytes(range(256))
+
+
+@dataclass
+class Spec:  # pylint: disable=too-many-instance-attributes
+    """What a synthetic document contains. The fields marked (PS) only
+    apply to PostScript."""
+
+    pages: int = 1
+    # Page sizes in points, used by the pages in turn; give more than one
+    # for mixed sizes
+    papers: Sequence[Tuple[int, int]] = (PAPER,)
+    # (PS) The size in bytes of extra procedures in the prolog
+    prolog_size: int = 0
+    # Whether to embed a Type 3 font, and use it rather than Helvetica
+    font: bool = False
+    # The width and height in pixels of an RGB image on each page, or 0 for
+    # none
+    image: int = 0
+    # (PS) The size of a binary %%BeginData section on each page, or 0 for
+    # none
+    binary_data: int = 0
+    # The line ending: b"\n", b"\r" or b"\r\n"
+    newline: bytes = b"\n"
+    # (PS) Whether to embed an EPS document, with %%BeginDocument, in each
+    # page
+    nested_document: bool = False
+
+
+class Output:
+    """Write to `file', counting the bytes written, so that PDF object
+    offsets are known without seeking. Text has its line endings
+    converted to `newline'; binary data is written unchanged."""
+
+    def __init__(self, file: IO[bytes], newline: bytes) -> None:
+        self.file = file
+        self.newline = newline
+        self.offset = 0
+
+    def write(self, data: bytes) -> None:
+        self.file.write(data)
+        self.offset += len(data)
+
+    def text(self, text: str) -> None:
+        self.write(text.encode("latin-1").replace(b"\n", self.newline))
+
+
+# Return `n' bytes of binary data, different for each `seed'.
+def binary(n: int, seed: int) -> bytes:
+    start = seed % len(BYTES)
+    return ((BYTES[start:] + BYTES[:start]) * (n // len(BYTES) + 1))[:n]
+
+
+def paper_name(paper: Tuple[int, int]) -> str:
+    return f"synthetic{paper[0]}x{paper[1]}"
+
+
+def ps_prolog(spec: Spec) -> str:
+    lines = [
+        "%%BeginResource: procset synthetic 1.0 0",
+        "/rectstroke where { pop } { /rectstroke { 4 2 roll moveto 1 index 0",
+        "rlineto 0 exch rlineto neg 0 rlineto closepath stroke } bind def }",
+        "ifelse",
+    ]
+    size = sum(len(line) + 1 for line in lines)
+    n = 0
+    while size < spec.prolog_size:
+        line = f"/SyntheticProc{n} {{ {n} pop }} bind def"
+        lines.append(line)
+        size += len(line) + 1
+        n += 1
+    lines.append("%%EndResource")
+    if spec.font:
+        lines += [
+            "%%BeginResource: font SyntheticFont",
+            "8 dict begin",
+            "/FontType 3 def",
+            "/FontMatrix [0.001 0 0 0.001 0 0] def",
+            "/FontBBox [0 0 600 700] def",
+            "/Encoding StandardEncoding def",
+            "/BuildChar { pop pop 600 0 50 0 550 700 setcachedevice",
+            "50 0 500 700 rectfill } bind def",
+            "currentdict end /SyntheticFont exch definefont pop",
+            "%%EndResource",
+        ]
+    return "\n".join(lines) + "\n"
+
+
+def ps_image(spec: Spec, page: int) -> str:
+    data = binary(spec.image * spec.image * 3, page).hex()
+    lines = [data[i : i + 64] for i in range(0, len(data), 64)]
+    return (
+        f"gsave 72 72 translate 144 144 scale {spec.image} {spec.image} 8\n"
+        f"[{spec.image} 0 0 -{spec.image} 0 {spec.image}]\n"
+        "currentfile /ASCIIHexDecode filter false 3 colorimage\n"
+        + "\n".join(lines)
+        + ">\ngrestore\n"
+    )
+
+
+def ps_nested_document(page: int) -> str:
+    return (
+        "save /showpage {} def\n"
+        f"%%BeginDocument: nested-{page}.eps\n"
+        "%!PS-Adobe-3.0 EPSF-3.0\n"
+        "%%BoundingBox: 0 0 100 100\n"
+        "%%Pages: 1\n"
+        "%%EndComments\n"
+        "%%Page: 1 1\n"
+        "0.5 setgray 300 72 100 100 rectfill\n"
+        "showpage\n"
+        "%%Trailer\n"
+        "%%EOF\n"
+        "%%EndDocument\n"
+        "restore\n"
+    )
+
+
+def write_ps(file: IO[bytes], spec: Spec) -> None:
+    """Write a DSC-conformant PostScript document to `file'."""
+    out = Output(file, spec.newline)
+    width, height = spec.papers[0]
+    media = "\n%%+ ".join(
+        f"{paper_name(paper)} {paper[0]} {paper[1]} 0 () ()" for paper in spec.papers
+    )
+    supplied = "procset synthetic 1.0 0"
+    if spec.font:
+        supplied += "\n%%+ font SyntheticFont"
+    out.text(
+        "%!PS-Adobe-3.0\n"
+        "%%Title: synthetic\n"
+        "%%Creator: synthetic.py\n"
+        f"%%BoundingBox: 0 0 {width} {height}\n"
+        f"%%DocumentMedia: {media}\n"
+        f"%%Pages: {spec.pages}\n"
+        f"%%DocumentSuppliedResources: {supplied}\n"
+        + ("" if spec.font else "%%DocumentNeededResources: font Helvetica\n")
+        + "%%EndComments\n"
+        + "%%BeginProlog\n"
+        + ps_prolog(spec)
+        + "%%EndProlog\n"
+        + "%%BeginSetup\n"
+        + f"<< /PageSize [{width} {height}] >> setpagedevice\n"
+        + "%%EndSetup\n"
+    )
+    font = "SyntheticFont" if spec.font else "Helvetica"
+    for page in range(1, spec.pages + 1):
+        paper = spec.papers[(page - 1) % len(spec.papers)]
+        width, height = paper
+        out.text(f"%%Page: {page} {page}\n")
+        if len(spec.papers) > 1:
+            out.text(
+                f"%%PageMedia: {paper_name(paper)}\n"
+                f"%%PageBoundingBox: 0 0 {width} {height}\n"
+                "%%BeginPageSetup\n"
+                f"<< /PageSize [{width} {height}] >> setpagedevice\n"
+                "%%EndPageSetup\n"
+            )
+        out.text(
+            f"0 setgray 4 setlinewidth 36 36 {width - 72} {height - 72} rectstroke\n"
+            f"/{font} findfont 48 scalefont setfont 72 {height // 2} moveto\n"
+            f"(Page {page}) show\n"
+        )
+        if spec.image > 0:
+            out.text(ps_image(spec, page))
+        if spec.binary_data > 0:
+            code = f"currentfile {spec.binary_data} string readstring\n"
+            data = binary(spec.binary_data, page)
+            size = len(code) + len(data) + len(" pop pop\n")
+            out.text(f"%%BeginData: {size} Binary Bytes\n{code}")
+            out.write(data)
+            out.text(" pop pop\n%%EndData\n")
+        if spec.nested_document:
+            out.text(ps_nested_document(page))
+        out.text("showpage\n%%PageTrailer\n")
+    out.text("%%Trailer\n%%EOF\n")
+
+
+def write_pdf(file: IO[bytes], spec: Spec) -> None:
+    """Write a PDF document to `file'."""
+    out = Output(file, spec.newline)
+    offsets: Dict[int, int] = {}
+
+    # Objects are numbered from 1: the catalog, the page tree, the font and
+    # its glyph, then for each page, the page, its contents and its image.
+    per_page = 3 if spec.image > 0 else 2
+
+    def page_object(page: int) -> int:
+        return 5 + per_page * page
+
+    def write_object(number: int, body: str, stream: bytes = b"") -> None:
+        offsets[number] = out.offset
+        out.text(f"{number} 0 obj\n{body}\n")
+        if stream != b"":
+            # A lone CR may not end the stream keyword
+            out.write(b"stream\r\n" if spec.newline == b"\r\n" else b"stream\n")
+            out.write(stream)
+            out.text("\nendstream\n")
+        out.text("endobj\n")
+
+    out.text("%PDF-1.4\n")
+    out.write(b"%\xe2\xe3\xcf\xd3")
+    out.text("\n")
+    write_object(1, "<< /Type /Catalog /Pages 2 0 R >>")
+    if spec.font:
+        glyph = b"600 0 50 0 550 700 d1 50 0 500 700 re f"
+        write_object(
+            3,
+            "<< /Type /Font /Subtype /Type3 /FontBBox [0 0 600 700]\n"
+            "/FontMatrix [0.001 0 0 0.001 0 0] /CharProcs << /box 4 0 R >>\n"
+            "/Encoding << /Type /Encoding /Differences [32"
+            + " /box" * 95
+            + "] >>\n/FirstChar 32 /LastChar 126 /Widths ["
+            + " 600" * 95
+            + "] /Resources << >> >>",
+        )
+        write_object(4, f"<< /Length {len(glyph)} >>", glyph)
+    else:
+        write_object(3, "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>")
+    for page in range(spec.pages):
+        number = page_object(page)
+        width, height = spec.papers[page % len(spec.papers)]
+        resources = "/Font << /F1 3 0 R >>"
+        content = (
+            f"4 w 36 36 {width - 72} {height - 72} re S\n"
+            f"BT /F1 48 Tf 72 {height // 2} Td (Page {page + 1}) Tj ET"
+        )
+        if spec.image > 0:
+            resources += f" /XObject << /Im1 {number + 2} 0 R >>"
+            content += "\nq 144 0 0 144 72 72 cm /Im1 Do Q"
+        write_object(
+            number,
+            f"<< /Type /Page /Parent 2 0 R /MediaBox [0 0 {width} {height}]\n"
+            f"/Contents {number + 1} 0 R /Resources << {resources} >> >>",
+        )
+        data = content.encode("ascii")
+        write_object(number + 1, f"<< /Length {len(data)} >>", data)
+        if spec.image > 0:
+            data = binary(spec.image * spec.image * 3, page)
+            write_object(
+                number + 2,
+                f"<< /Type /XObject /Subtype /Image /Width {spec.image}\n"
+                f"/Height {spec.image} /ColorSpace /DeviceRGB "
+                f"/BitsPerComponent 8 /Length {len(data)} >>",
+                data,
+            )
+    offsets[2] = out.offset
+    out.text(f"2 0 obj\n<< /Type /Pages /Count {spec.pages} /Kids [\n")
+    for page in range(spec.pages):
+        out.text(f"{page_object(page)} 0 R\n")
+    out.text("] >>\nendobj\n")
+
+    # Cross-reference entries are 20 bytes, whatever the line ending
+    eol = "\r\n" if spec.newline == b"\r\n" else " " + spec.newline.decode("ascii")
+    xref = out.offset
+    size = max(offsets) + 1
+    out.text(f"xref\n0 {size}\n")
+    out.write(f"0000000000 65535 f{eol}".encode("ascii"))
+    for number in range(1, size):
+        if number in offsets:
+            out.write(f"{offsets[number]:010} 00000 n{eol}".encode("ascii"))
+        else:
+            out.write(f"0000000000 00000 f{eol}".encode("ascii"))
+    out.text(f"trailer\n<< /Size {size} /Root 1 0 R >>\nstartxref\n{xref}\n%%EOF\n")
+
+
+def write_document(file: IO[bytes], spec: Spec, file_format: str) -> None:
+    """Write a document in `file_format', "ps" or "pdf", to `file'."""
+    if file_format == "pdf":
+        write_pdf(file, spec)
+    else:
+        write_ps(file, spec)
+
+
+def parse_papers(text: str) -> List[Tuple[int, int]]:
+    papers = []
+    for paper in text.split(","):
+        width, height = paper.split("x")
+        papers.append((int(width), int(height)))
+    return papers
+
+
+def get_parser() -> argparse.ArgumentParser:
+    parser = argparse.ArgumentParser(
+        description="Write a synthetic PostScript or PDF document."
+    )
+    parser.add_argument("--pages", type=int, default=1, help="number of pages")
+    parser.add_argument(
+        "--papers",
+        type=parse_papers,
+        default=[PAPER],
+        help="comma-separated page sizes in points, used in turn "
+        + "[default: 595x842]",
+    )
+    parser.add_argument(
+        "--prolog-size", type=int, default=0, help="(PS) extra bytes of prolog"
+    )
+    parser.add_argument("--font", action="store_true", help="embed a Type 3 font")
+    parser.add_argument(
+        "--image", type=int, default=0, help="size in pixels of an image on each page"
+    )
+    parser.add_argument(
+        "--binary-data",
+        type=int,
+        default=0,
+        help="(PS) size of a binary %%%%BeginData section on each page",
+    )
+    parser.add_argument(
+        "--newline",
+        choices=["lf", "cr", "crlf"],
+        default="lf",
+        help="line ending [default: lf]",
+    )
+    parser.add_argument(
+        "--nested-document",
+        action="store_true",
+        help="(PS) embed an EPS document in each page",
+    )
+    parser.add_argument(
+        "--format", choices=["ps", "pdf"], help="format [default: from OUTFILE]"
+    )
+    parser.add_argument("outfile", metavar="OUTFILE", help="`-' means standard output")
+    return parser
+
+
+def main(argv: List[str]) -> None:
+    args = get_parser().parse_args(argv)
+    spec = Spec(
+        args.pages,
+        args.papers,
+        args.prolog_size,
+        args.font,
+        args.image,
+        args.binary_data,
+        {"lf": b"\n", "cr": b"\r", "crlf": b"\r\n"}[args.newline],
+        args.nested_document,
+    )
+    file_format = args.format or ("pdf" if args.outfile.endswith(".pdf") else "ps")
+    if args.outfile == "-":
+        write_document(sys.stdout.buffer, spec, file_format)
+    else:
+        with open(args.outfile, "wb") as file:
+            write_document(file, spec, file_format)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,44 @@
+import asyncio
+import sys
+from pathlib import Path
+from typing import AsyncIterator, List
+
+from testutils import make_tests, file_test
+from test_api import SHARED_CASES
+import psutils.api
+from psutils.aio import stream
+from psutils.api import PsutilsError
+
+
+async def read_chunks(infile: str) -> AsyncIterator[bytes]:
+    with open(infile, "rb") as h:
+        while chunk := h.read(4096):
+            yield chunk
+
+
+async def write_chunks(
+    function: str, params: List[str], infile: str, outfile: str
+) -> None:
+    with open(outfile, "wb") as h:
+        async for chunk in stream(
+            getattr(psutils.api, function), read_chunks(infile), *params
+        ):
+            h.write(chunk)
+
+
+def aio(args: List[str]) -> None:
+    # Stream the input through the API function given by `args'
+    function, *params, infile, outfile = args
+    try:
+        asyncio.run(write_chunks(function, params, infile, outfile))
+    except PsutilsError as e:
+        print(f"{function}: {e}", file=sys.stderr)
+        sys.exit(e.code)
+
+
+pytestmark = make_tests(
+    aio,
+    Path(__file__).parent.resolve() / "test-files",
+    *SHARED_CASES,
+)
+test_aio = file_test
@@ -0,0 +1,47 @@
+import sys
+from pathlib import Path
+from typing import List
+
+from testutils import make_tests, file_test, Case, GeneratedInput
+import psutils.api
+from psutils.api import PsutilsError
+
+
+def api(args: List[str]) -> None:
+    # Call the API function given by `args' on the contents of the input
+    function, *params, infile, outfile = args
+    with open(infile, "rb") as h:
+        data = h.read()
+    try:
+        getattr(psutils.api, function)(data, *params, output=outfile)
+    except PsutilsError as e:
+        print(f"{function}: {e}", file=sys.stderr)
+        sys.exit(e.code)
+
+
+# Cases shared with the tests of psutils.aio
+SHARED_CASES = [
+    Case(
+        "pipe",
+        ["pipe", "psselect 1-8 | psbook | psnup -2"],
+        GeneratedInput("a4", 20),
+    ),
+    Case(
+        "invalid-page-range",
+        ["select", "99"],
+        GeneratedInput("a4", 20),
+        2,
+    ),
+]
+
+pytestmark = make_tests(
+    api,
+    Path(__file__).parent.resolve() / "test-files",
+    Case(
+        "select",
+        ["select", "2-4"],
+        GeneratedInput("a4", 20),
+    ),
+    *SHARED_CASES,
+)
+test_api = file_test
@@ -0,0 +1,105 @@
+import io
+import json
+import os
+from contextlib import redirect_stdout
+from pathlib import Path
+from typing import Any, Dict, List, Tuple, Union
+
+from pytest import MonkeyPatch
+
+from psutils import batch
+from psutils.command.psnup import psnup
+from psutils.command.psutils import psutils
+
+INPUT = str(Path(__file__).parent / "test-files" / "a4-20.ps")
+
+
+def job(tmp_path: Path, id_: str, command: str, args: List[str]) -> Dict[str, Any]:
+    output = str(tmp_path / f"{id_}.ps")
+    return {
+        "id": id_,
+        "command": command,
+        "args": args,
+        "input": INPUT,
+        "output": output,
+    }
+
+
+def run_batch(
+    tmp_path: Path, jobs: List[Union[Dict[str, Any], str]], *options: str
+) -> Tuple[int, Dict[str, Dict[str, Any]]]:
+    # Run `jobs', given as objects or lines of the manifest, and return the
+    # exit status and the report of each job, by id
+    manifest = tmp_path / "manifest.jsonl"
+    lines = [job if isinstance(job, str) else json.dumps(job) for job in jobs]
+    manifest.write_text("".join(line + "\n" for line in lines), encoding="utf-8")
+    report = io.StringIO()
+    status = 0
+    with redirect_stdout(report):
+        try:
+            psutils(["batch", *options, str(manifest)])
+        except SystemExit as e:
+            assert isinstance(e.code, int)
+            status = e.code
+    results = map(json.loads, report.getvalue().splitlines())
+    return status, {result["id"]: result for result in results}
+
+
+def test_success(tmp_path: Path) -> None:
+    status, results = run_batch(
+        tmp_path,
+        [
+            job(tmp_path, "nup", "psnup", ["-2"]),
+            job(tmp_path, "select", "psselect", ["-p1-3"]),
+        ],
+    )
+    assert status == 0
+    assert {id_: result["status"] for id_, result in results.items()} == {
+        "nup": 0,
+        "select": 0,
+    }
+    psnup(["-q", "-2", INPUT, str(tmp_path / "expected.ps")])
+    expected = (tmp_path / "expected.ps").read_bytes()
+    assert (tmp_path / "nup.ps").read_bytes() == expected
+
+
+def test_mixed_success_and_failure(tmp_path: Path) -> None:
+    status, results = run_batch(
+        tmp_path,
+        [
+            job(tmp_path, "good", "psnup", ["-2"]),
+            job(tmp_path, "bad-range", "psselect", ["-p99"]),
+            {"command": "psnup", "input": INPUT, "output": "-"},
+            "not JSON",
+        ],
+    )
+    assert status == 1
+    assert results["good"]["status"] == 0
+    assert (tmp_path / "good.ps").exists()
+    assert results["bad-range"]["status"] == 2
+    assert "page range 99 is invalid" in results["bad-range"]["messages"]
+    assert results["3"]["status"] == 1
+    assert "cannot write to standard output" in results["3"]["messages"]
+    assert results["4"]["status"] == 1
+    assert results["4"]["messages"].startswith("invalid job:")
+
+
+def crash(_argv: List[str]) -> None:
+    os._exit(3)
+
+
+def test_crashed_worker(tmp_path: Path, monkeypatch: MonkeyPatch) -> None:
+    # A job that kills its worker fails on its own; the jobs running beside
+    # it, and those after it, still succeed
+    monkeypatch.setitem(batch.COMMANDS, "crash", crash)
+    jobs: List[Union[Dict[str, Any], str]]
+    jobs = [job(tmp_path, f"nup-{n}", "psnup", ["-2"]) for n in range(6)]
+    jobs.insert(2, job(tmp_path, "crash", "crash", []))
+    status, results = run_batch(tmp_path, jobs, "-j3")
+    assert status == 1
+    assert len(results) == 7
+    assert results["crash"]["status"] == 2
+    assert results["crash"]["messages"] == "crash: worker process died\n"
+    for n in range(6):
+        assert results[f"nup-{n}"]["status"] == 0
+        assert (tmp_path / f"nup-{n}.ps").exists()
@@ -0,0 +1,83 @@
+import json
+from pathlib import Path
+from typing import Callable, Iterator, List
+
+import pytest
+from pytest import MonkeyPatch
+
+from psutils.command.psnup import psnup
+from psutils.command.pstops import pstops
+from psutils.libpaper import paper_size
+
+INPUT = Path(__file__).parent / "test-files" / "a4-20"
+
+
+def run(
+    tmp_path: Path,
+    file_type: str,
+    output: str,
+    args: List[str],
+    command: Callable[[List[str]], None] = psnup,
+) -> bool:
+    # Run `command' with a cache, and return whether the output was copied
+    # from the cache
+    stats = tmp_path / "stats.json"
+    command(
+        [
+            f"--cache-dir={tmp_path / 'cache'}",
+            f"--stats-file={stats}",
+            "-q",
+            *args,
+            str(INPUT.with_suffix(file_type)),
+            str(tmp_path / f"{output}{file_type}"),
+        ]
+    )
+    return "cache" in json.loads(stats.read_text(encoding="utf-8"))["fast_paths"]
+
+
+def test_hit(tmp_path: Path, file_type: str) -> None:
+    assert not run(tmp_path, file_type, "first", ["-2"])
+    assert run(tmp_path, file_type, "second", ["-2"])
+    first = (tmp_path / f"first{file_type}").read_bytes()
+    assert (tmp_path / f"second{file_type}").read_bytes() == first
+
+    # Options that only change how the output is written share the entry
+    assert run(tmp_path, file_type, "jobs", ["-2", "--jobs=2"])
+    assert run(tmp_path, file_type, "pipeline", ["-2", "--pipeline"])
+
+    # Other options do not
+    assert not run(tmp_path, file_type, "four", ["-4"])
+
+
+@pytest.fixture(name="set_default_paper")
+def fixture_set_default_paper(
+    monkeypatch: MonkeyPatch,
+) -> Iterator[Callable[[str], None]]:
+    # Return a function that sets the default paper; the sizes looked up
+    # are forgotten afterwards
+    def set_paper(name: str) -> None:
+        monkeypatch.setenv("PAPERSIZE", name)
+        paper_size.cache_clear()
+
+    yield set_paper
+    paper_size.cache_clear()
+
+
+def test_default_paper(
+    tmp_path: Path, file_type: str, set_default_paper: Callable[[str], None]
+) -> None:
+    # The default paper size is part of the key when no paper is given; here
+    # it gives the offset of the page
+    spec = ["0(0.1w,0)"]
+    set_default_paper("a4")
+    assert not run(tmp_path, file_type, "a4", spec, pstops)
+    set_default_paper("a5")
+    assert not run(tmp_path, file_type, "a5", spec, pstops)
+    assert run(tmp_path, file_type, "a5-again", spec, pstops)
+    a4 = (tmp_path / f"a4{file_type}").read_bytes()
+    assert (tmp_path / f"a5{file_type}").read_bytes() != a4
+
+    # ...but not when a paper is given
+    assert not run(tmp_path, file_type, "given", ["-pa4", *spec], pstops)
+    set_default_paper("a4")
+    assert run(tmp_path, file_type, "given-again", ["-pa4", *spec], pstops)
@@ -0,0 +1,84 @@
+import io
+import json
+from pathlib import Path
+from typing import List
+
+from pypdf import PdfReader
+from pytest import CaptureFixture, mark
+
+from synthetic import Spec, write_document
+from psutils.command.psbook import psbook
+from psutils.command.psnup import psnup
+
+COMMANDS = {"psnup": psnup, "psbook": psbook}
+
+
+def make_input(path: Path, file_type: str, changed_page: int = 0) -> None:
+    # Write a document of 20 pages, with page `changed_page' changed, if any,
+    # without changing its length
+    buffer = io.BytesIO()
+    write_document(buffer, Spec(20), file_type[1:])
+    data = buffer.getvalue()
+    if changed_page > 0:
+        label = f"(Page {changed_page})".encode("ascii")
+        assert data.count(label) == 1
+        data = data.replace(label, label.replace(b"Page", b"PAGE"))
+    path.write_bytes(data)
+
+
+def run(command: str, args: List[str], infile: Path, outfile: Path) -> int:
+    # Run `command' with --incremental, and return how many sheets it reused
+    stats = infile.with_name("stats.json")
+    COMMANDS[command](
+        ["--incremental", f"--stats-file={stats}", *args, str(infile), str(outfile)]
+    )
+    return int(json.loads(stats.read_text(encoding="utf-8"))["sheets_reused"])
+
+
+def pages(path: Path, file_type: str) -> List[bytes]:
+    # Return the content of each page of the document `path'
+    if file_type == ".ps":
+        return [path.read_bytes()]
+    contents = [page.get_contents() for page in PdfReader(path).pages]
+    return [b"" if content is None else content.get_data() for content in contents]
+
+
+@mark.parametrize(
+    "command,args,sheets,changed_page,dirty",
+    [
+        ("psnup", ["-q", "-2"], 10, 5, 1),
+        ("psbook", ["-q", "-s8"], 24, 5, 1),
+        ("psnup", ["-q", "-4"], 5, 0, 0),
+    ],
+)
+def test_rebuild_dirty_sheets(
+    command: str,
+    args: List[str],
+    sheets: int,
+    changed_page: int,
+    dirty: int,
+    file_type: str,
+    tmp_path: Path,
+) -> None:
+    infile = tmp_path / f"input{file_type}"
+    outfile = tmp_path / f"output{file_type}"
+    make_input(infile, file_type)
+    assert run(command, args, infile, outfile) == 0
+
+    # Change a page, and only the sheets it is on are built again
+    make_input(infile, file_type, changed_page)
+    assert run(command, args, infile, outfile) == sheets - dirty
+
+    # The result is the same as that of a fresh run
+    fresh = tmp_path / f"fresh{file_type}"
+    COMMANDS[command]([*args, str(infile), str(fresh)])
+    assert pages(outfile, file_type) == pages(fresh, file_type)
+
+
+def test_jobs_warning(tmp_path: Path, capsys: CaptureFixture[str]) -> None:
+    infile = tmp_path / "input.ps"
+    make_input(infile, ".ps")
+    run("psnup", ["-q", "-2", "--jobs=2"], infile, tmp_path / "output.ps")
+    assert "--jobs and --pipeline are not used with --incremental" in (
+        capsys.readouterr().err
+    )
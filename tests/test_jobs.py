@@ -0,0 +1,108 @@
+import multiprocessing
+import os
+from pathlib import Path
+from typing import Callable, List
+
+import pytest
+from pytest import CaptureFixture, MonkeyPatch
+
+from psutils.command.psnup import psnup
+from psutils.command.psselect import psselect
+from psutils.transformers import PdfTransform
+
+TEST_FILES = Path(__file__).parent / "test-files"
+
+
+@pytest.mark.parametrize(
+    "function,args",
+    [
+        (psnup, ["-pa4", "-2"]),
+        (psnup, ["-pa4", "-4"]),
+        (psselect, ["-r"]),
+        (psselect, ["-e", "-p1-7"]),
+    ],
+)
+@pytest.mark.parametrize("jobs", [2, 3, 8])
+def test_jobs_same_as_serial(
+    function: Callable[[List[str]], None],
+    args: List[str],
+    jobs: int,
+    file_type: str,
+    tmp_path: Path,
+    monkeypatch: MonkeyPatch,
+    capsys: CaptureFixture[str],
+) -> None:
+    monkeypatch.setenv("SOURCE_DATE_EPOCH", "0")
+    infile = str(TEST_FILES / f"a4-20{file_type}")
+    serial = tmp_path / f"serial{file_type}"
+    parallel = tmp_path / f"parallel{file_type}"
+    function(["-q", *args, infile, str(serial)])
+    capsys.readouterr()
+    function(["-q", f"--jobs={jobs}", *args, infile, str(parallel)])
+    assert parallel.read_bytes() == serial.read_bytes()
+    assert "--jobs" not in capsys.readouterr().err
+
+
+# Links between pages written by different processes are kept.
+@pytest.mark.parametrize("args", [["-pa4", "-2"], ["-r"], ["-p1-7,3,9-_1"]])
+def test_jobs_links_same_as_serial(
+    args: List[str], tmp_path: Path, monkeypatch: MonkeyPatch
+) -> None:
+    monkeypatch.setenv("SOURCE_DATE_EPOCH", "0")
+    infile = str(TEST_FILES / "recursive-links.pdf")
+    function: Callable[[List[str]], None] = psnup if "-2" in args else psselect
+    serial = tmp_path / "serial.pdf"
+    parallel = tmp_path / "parallel.pdf"
+    function(["-q", *args, infile, str(serial)])
+    function(["-q", "--jobs=3", *args, infile, str(parallel)])
+    assert parallel.read_bytes() == serial.read_bytes()
+
+
+# Where PDF segments cannot be grafted, the output is written by one process.
+def test_jobs_pdf_without_graft(
+    tmp_path: Path, monkeypatch: MonkeyPatch, capsys: CaptureFixture[str]
+) -> None:
+    monkeypatch.setenv("SOURCE_DATE_EPOCH", "0")
+    monkeypatch.setattr(PdfTransform, "parallel", False)
+    infile = str(TEST_FILES / "a4-20.pdf")
+    serial = tmp_path / "serial.pdf"
+    parallel = tmp_path / "parallel.pdf"
+    psnup(["-q", "-pa4", "-2", infile, str(serial)])
+    psnup(["-q", "--jobs=2", "-pa4", "-2", infile, str(parallel)])
+    assert parallel.read_bytes() == serial.read_bytes()
+    warning = "--jobs is not used for PDF output with this version of pypdf"
+    assert warning in capsys.readouterr().err
+
+
+# Where processes cannot be forked, the output is written by one process.
+@pytest.mark.parametrize(
+    "option,args",
+    [
+        ("--jobs", ["--jobs=2", "-pa4", "-2"]),
+        ("--split", ["--split=3", "-pa4", "-2"]),
+        ("--fan-out", ["--fan-out=-q -4 four", "-pa4", "-2"]),
+    ],
+)
+def test_no_fork_same_as_fork(
+    option: str,
+    args: List[str],
+    file_type: str,
+    tmp_path: Path,
+    monkeypatch: MonkeyPatch,
+    capsys: CaptureFixture[str],
+) -> None:
+    monkeypatch.setenv("SOURCE_DATE_EPOCH", "0")
+    infile = str(TEST_FILES / f"a4-20{file_type}")
+    outputs = {}
+    for fork in (True, False):
+        if not fork:
+            monkeypatch.setattr(multiprocessing, "get_all_start_methods", list)
+        directory = tmp_path / str(fork)
+        directory.mkdir()
+        monkeypatch.chdir(directory)
+        psnup(["-q", *args, infile, f"output-%d{file_type}"])
+        outputs[fork] = {name: (directory / name).read_bytes() for name in os.listdir()}
+    assert len(outputs[True]) > 1 or option == "--jobs"
+    assert outputs[False] == outputs[True]
+    warning = f"{option} is only used where processes can be forked"
+    assert warning in capsys.readouterr().err
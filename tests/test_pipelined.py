@@ -0,0 +1,63 @@
+import io
+import threading
+import time
+from pathlib import Path
+from typing import Dict, List
+
+from pytest import CaptureFixture, MonkeyPatch
+
+from psutils.command.psselect import get_args, psselect, select
+from psutils.io import setup_input
+from psutils.readers import document_reader
+from psutils.transformers import PsTransform
+
+TEST_FILES = Path(__file__).parent / "test-files"
+
+
+class RecordingFile(io.BytesIO):
+    """An output file that records when it is written to."""
+
+    def __init__(self, events: List[str]) -> None:
+        super().__init__()
+        self.events = events
+
+    def write(self, data: bytes) -> int:  # type: ignore[override]
+        self.events.append("write")
+        return super().write(data)
+
+
+def test_pipeline_overlaps_reading_and_writing(monkeypatch: MonkeyPatch) -> None:
+    # Slow down reading, so that writing can only start before reading ends
+    # if the stages overlap
+    events: List[str] = []
+    read_pages = PsTransform.read_pages
+    reader_threads = set()
+
+    def slow_read_pages(self: PsTransform, pages: List[int]) -> Dict[int, bytes]:
+        reader_threads.add(threading.get_ident())
+        time.sleep(0.02)
+        events.append("read")
+        return read_pages(self, pages)
+
+    monkeypatch.setattr(PsTransform, "read_pages", slow_read_pages)
+    args = get_args(["-q", "--pipeline", "-p1-20", str(TEST_FILES / "a4-20.ps")])
+    outfile = RecordingFile(events)
+    with setup_input(args.infile) as (infile, file_type):
+        select(document_reader(infile, file_type), args, outfile)
+    assert threading.get_ident() not in reader_threads
+    first_read = events.index("read")
+    last_read = len(events) - 1 - events[::-1].index("read")
+    assert "write" in events[first_read:last_read]
+
+    # The output is the same as without --pipeline
+    serial = RecordingFile([])
+    args.pipeline = False
+    with setup_input(args.infile) as (infile, file_type):
+        select(document_reader(infile, file_type), args, serial)
+    assert outfile.getvalue() == serial.getvalue()
+
+
+def test_pipeline_pdf_warns(tmp_path: Path, capsys: CaptureFixture[str]) -> None:
+    infile = str(TEST_FILES / "a4-20.pdf")
+    psselect(["--pipeline", "-p1-20", infile, str(tmp_path / "output.pdf")])
+    assert "--pipeline is only used for PostScript output" in capsys.readouterr().err
@@ -26,6 +26,12 @@ pytestmark = make_tests(
         ["-s", "4"],
         GeneratedInput("a4", 20),
     ),
+    Case(
+        "20-split-signatures",
+        ["-s", "8", "--split-signatures"],
+        GeneratedInput("a4", 20),
+        outputs=3,
+    ),
     Case(
         "invalid-signature-size",
         ["-s", "3"],
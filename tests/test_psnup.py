@@ -156,5 +156,30 @@ pytestmark = make_tests(
         ["-2", "-P612x792", "-ptabloid"],
         "no-document-media",
     ),
+    Case(
+        "chained",
+        ["-pa4", "-2"],
+        "pstops/texlive/expected",
+    ),
+    # The input's procset redefines initclip, which its pages call, so the
+    # light procset cannot be used.
+    Case(
+        "chained-light-procset",
+        ["-pa4", "-2", "--light-procset"],
+        "pstops/texlive/expected",
+    ),
+    # The appended document's prolog differs, so goes in each of its pages.
+    Case(
+        "append",
+        ["-2"],
+        GeneratedInput("a4", 3),
+        append=[GeneratedInput("a4", 2), GeneratedInput("a5", 1)],
+    ),
+    Case(
+        "split",
+        ["-2", "--split", "4"],
+        GeneratedInput("a4", 20),
+        outputs=3,
+    ),
 )
 test_psnup = file_test
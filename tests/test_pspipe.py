@@ -0,0 +1,26 @@
+from pathlib import Path
+
+from testutils import file_test, make_tests, Case, GeneratedInput
+from psutils.command.pspipe import pspipe
+
+pytestmark = make_tests(
+    pspipe,
+    Path(__file__).parent.resolve() / "test-files",
+    Case(
+        "select-book-nup",
+        ["psselect 3-18 | psbook -s8 | psnup -2 -pa4"],
+        GeneratedInput("a4", 20),
+    ),
+    Case(
+        "select-reverse-book",
+        ["psselect -r -e | psbook"],
+        GeneratedInput("a4", 20),
+    ),
+    Case(
+        "nup-not-last",
+        ["psnup -2 | psbook"],
+        "no-input",
+        1,
+    ),
+)
+test_pspipe = file_test
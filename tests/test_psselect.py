@@ -21,6 +21,17 @@ pytestmark = make_tests(
         ["-r"],
         GeneratedInput("a4", 20),
     ),
+    Case(
+        "page-labels",
+        ["--page-labels", "-r"],
+        GeneratedInput("a4", 20),
+    ),
+    # Test writing a second output from the same input.
+    Case(
+        "odd-fan-out",
+        ["-o", "--fan-out=-q -e even"],
+        GeneratedInput("a4", 20),
+    ),
     Case(
         "even-reverse",
         ["-e", "-r"],
@@ -60,6 +71,25 @@ pytestmark = make_tests(
         GeneratedInput("a4", 1),
         2,
     ),
+    # Test reading a pipe, which is streamed when the pages are in order.
+    Case(
+        "stdin",
+        ["-p", "3-7"],
+        GeneratedInput("a4", 20),
+        stdin=True,
+    ),
+    Case(
+        "stdin-reverse",
+        ["-r"],
+        GeneratedInput("a4", 20),
+        stdin=True,
+    ),
+    Case(
+        "append-reverse",
+        ["-r"],
+        GeneratedInput("a4", 3),
+        append=[GeneratedInput("a4", 2)],
+    ),
     Case(
         "texlive",
         ["5-15"],
@@ -70,5 +100,10 @@ pytestmark = make_tests(
         ["--pages", "1-18"],
         GeneratedInput("a4", 20),
     ),
+    Case(
+        "prune-resources",
+        ["--prune-resources", "-p2"],
+        "page-resources",
+    ),
 )
 test_psselect = file_test
@@ -58,6 +58,22 @@ pytestmark = make_tests(
         ],
         GeneratedInput("a4", 20),
     ),
+    Case(
+        "light-procset",
+        [
+            "--light-procset",
+            "-pa4",
+            "--specs",
+            "2:0L@.7(21cm,0)+1L@.7(21cm,14.85cm)",
+        ],
+        GeneratedInput("a4", 2),
+    ),
+    # Test that an earlier PStoPS procset is replaced rather than stacked.
+    Case(
+        "chained",
+        ["-pa4", "--specs", "2:0L@.7(21cm,0)+1L@.7(21cm,14.85cm)"],
+        "psnup/20-2/expected",
+    ),
 )
 with mock.patch.dict(os.environ, {"PAPERSIZE": "A4"}):
     test_pstops = file_test
@@ -0,0 +1,98 @@
+from pathlib import Path
+from typing import List, Tuple, cast
+
+from pytest import MonkeyPatch
+
+from psutils import readers
+from psutils.command.psselect import psselect
+from psutils.io import COALESCE_GAP, READ_AHEAD, MappedFile, ReadAhead
+
+MIB = 1024 * 1024
+
+
+class AdviceLog:
+    """Stands in for a MappedFile, recording the advice given about it."""
+
+    def __init__(self) -> None:
+        self.advice: List[Tuple[int, int, bool]] = []
+
+    def advise(self, start: int, stop: int, needed: bool) -> None:
+        self.advice.append((start, stop, needed))
+
+    def needed(self) -> List[range]:
+        return [range(start, stop) for start, stop, needed in self.advice if needed]
+
+    def dropped(self) -> List[range]:
+        return [range(start, stop) for start, stop, needed in self.advice if not needed]
+
+
+def read_ahead(ranges: List[range], drop: bool = True) -> Tuple[ReadAhead, AdviceLog]:
+    log = AdviceLog()
+    return ReadAhead(cast(MappedFile, log), ranges, drop), log
+
+
+def test_coalesce() -> None:
+    # Ranges closer than COALESCE_GAP are asked for together, in file order
+    near = 1000 + COALESCE_GAP
+    far = near + 1000 + COALESCE_GAP + 1
+    ahead, log = read_ahead(
+        [range(far, far + 1000), range(0, 1000), range(near, near + 1000)]
+    )
+    ahead.reading(far)
+    assert log.needed() == [range(0, near + 1000), range(far, far + 1000)]
+
+
+def test_window() -> None:
+    # READ_AHEAD bytes are asked for at a time, and the next READ_AHEAD bytes
+    # when the reader is half way through what has been asked for
+    ranges = [range(i * 2 * MIB, i * 2 * MIB + MIB) for i in range(12)]
+    per_batch = READ_AHEAD // MIB
+    ahead, log = read_ahead(ranges)
+    ahead.reading(ranges[0].start)
+    assert log.needed() == ranges[:per_batch]
+    ahead.reading(ranges[per_batch // 2 - 1].start)
+    assert log.needed() == ranges[:per_batch]
+    ahead.reading(ranges[per_batch // 2].start)
+    assert log.needed() == ranges[: 2 * per_batch]
+
+
+def test_drop_behind() -> None:
+    # Ranges behind the reader are dropped when the next batch is asked for,
+    # merged where they touch, unless they will be read again
+    ranges = [range(i * MIB, (i + 1) * MIB) for i in range(8)]
+    order = [ranges[0], ranges[1], ranges[5], ranges[2], ranges[3], ranges[0]]
+    ahead, log = read_ahead(order)
+    for r in order[:3]:
+        ahead.reading(r.start)
+    assert log.dropped() == [ranges[1]]
+    for r in order[3:]:
+        ahead.reading(r.start)
+    assert log.dropped() == [ranges[1], range(2 * MIB, 4 * MIB), ranges[5]]
+
+
+def test_shared_not_dropped() -> None:
+    # When other processes read the file, nothing is dropped
+    ranges = [range(i * MIB, (i + 1) * MIB) for i in range(8)]
+    ahead, log = read_ahead(ranges, drop=False)
+    for r in ranges:
+        ahead.reading(r.start)
+    assert log.needed() != []
+    assert log.dropped() == []
+
+
+def test_jobs_share_input(tmp_path: Path, monkeypatch: MonkeyPatch) -> None:
+    # Workers writing with --jobs read the input at the same time, so must
+    # not drop it from the cache
+    drops: List[bool] = []
+
+    def recording_read_ahead(
+        mapped: MappedFile, ranges: List[range], drop: bool = True
+    ) -> ReadAhead:
+        drops.append(drop)
+        return ReadAhead(mapped, ranges, drop)
+
+    monkeypatch.setattr(readers, "ReadAhead", recording_read_ahead)
+    infile = str(Path(__file__).parent / "test-files" / "a4-20.ps")
+    psselect(["-q", "-r", infile, str(tmp_path / "serial.ps")])
+    psselect(["-q", "-r", "-j2", infile, str(tmp_path / "jobs.ps")])
+    assert drops == [True, False]
@@ -0,0 +1,18 @@
+from pathlib import Path
+
+from pytest import MonkeyPatch
+
+from psutils.command.psselect import psselect
+
+
+def test_source_date(file_type: str, tmp_path: Path, monkeypatch: MonkeyPatch) -> None:
+    monkeypatch.setenv("SOURCE_DATE_EPOCH", "0")
+    infile = Path(__file__).parent / "test-files" / f"a4-1{file_type}"
+    outfile = tmp_path / f"output{file_type}"
+    psselect(["-q", "1", str(infile), str(outfile)])
+    output = outfile.read_bytes()
+    if file_type == ".ps":
+        assert output.count(b"%%CreationDate") == 1
+        assert b"%%CreationDate: Thu Jan  1 00:00:00 1970\n" in output
+    else:
+        assert b"/CreationDate (D\\07219700101000000Z)" in output
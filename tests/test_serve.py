@@ -0,0 +1,203 @@
+import json
+import os
+import signal
+import socket
+import threading
+from pathlib import Path
+from typing import Any, Dict, Iterator, Optional, Tuple
+
+import pytest
+
+from psutils.command.psnup import psnup
+from psutils.server import Server, send_request
+
+INPUT = Path(__file__).parent / "test-files" / "a4-20.ps"
+
+
+class Serving:
+    """A server running on a thread, on a socket in `tmp_path'."""
+
+    def __init__(self, tmp_path: Path, **limits: int) -> None:
+        self.path = str(tmp_path / "psutils.sock")
+        self.server = Server(self.path, 1, **limits)
+        self.thread = threading.Thread(target=self.server.serve_forever)
+        self.thread.start()
+
+    def close(self) -> None:
+        self.server.shutdown()
+        self.thread.join()
+        self.server.server_close()
+
+    def connect(self) -> socket.socket:
+        s = socket.socket(socket.AF_UNIX)
+        s.connect(self.path)
+        return s
+
+
+@pytest.fixture(name="serving")
+def fixture_serving(tmp_path: Path) -> Iterator[Serving]:
+    server = Serving(tmp_path)
+    yield server
+    server.close()
+
+
+# Send `data' on a new connection to `server', and return the reply line,
+# parsed, and what follows it.
+def exchange(server: Serving, data: bytes) -> Tuple[Dict[str, Any], bytes]:
+    with server.connect() as s:
+        s.sendall(data)
+        s.shutdown(socket.SHUT_WR)
+        with s.makefile("rb") as stream:
+            return json.loads(stream.readline()), stream.read()
+
+
+def nup_job(size: Optional[int] = None) -> bytes:
+    job: Dict[str, Any] = {"id": "nup", "command": "psnup", "args": ["-2"]}
+    if size is not None:
+        job["input_size"] = size
+    return json.dumps(job).encode("utf-8") + b"\n"
+
+
+def test_output_framing(serving: Serving, tmp_path: Path) -> None:
+    # The output follows the reply, and is exactly output_size bytes long
+    data = INPUT.read_bytes()
+    reply, rest = exchange(serving, nup_job(len(data)) + data)
+    assert reply["status"] == 0
+    assert reply["output_size"] == len(rest)
+    psnup(["-q", "-2", str(INPUT), str(tmp_path / "expected.ps")])
+    assert rest == (tmp_path / "expected.ps").read_bytes()
+
+    # Bytes after the input are not taken as part of it
+    reply, rest2 = exchange(serving, nup_job(len(data)) + data + b"trailing")
+    assert reply["status"] == 0
+    assert rest2 == rest
+
+
+def test_files_named(serving: Serving, tmp_path: Path) -> None:
+    # With both files named, no output is sent
+    job = {"command": "psselect", "args": ["-p1-2"], "input": str(INPUT)}
+    job["output"] = str(tmp_path / "output.ps")
+    reply, rest = exchange(serving, json.dumps(job).encode("utf-8") + b"\n")
+    assert reply["status"] == 0
+    assert "output_size" not in reply
+    assert rest == b""
+    assert (tmp_path / "output.ps").exists()
+
+
+@pytest.mark.parametrize(
+    "data,message",
+    [
+        (b"not JSON\n", "invalid job: "),
+        (b"[]\n", "invalid job: job is not a JSON object"),
+        (b'{"command": "psfoo", "input_size": 0}\n', "unknown command `psfoo'"),
+        (
+            b'{"command": "psnup", "input_size": -1}\n',
+            "input_size must be a non-negative integer",
+        ),
+        (nup_job(100) + b"%!PS", "invalid job: input ended early"),
+        (
+            b'{"command": "psnup", "input_size": 0, "output": "-"}\n',
+            "a job cannot write to standard output",
+        ),
+    ],
+)
+def test_invalid_request(serving: Serving, data: bytes, message: str) -> None:
+    reply, rest = exchange(serving, data)
+    assert reply["status"] == 1
+    assert reply["messages"].startswith("invalid job: ")
+    assert message in reply["messages"]
+    assert rest == b""
+
+
+def test_failed_job(serving: Serving) -> None:
+    job = {"command": "psselect", "args": ["-p99"], "input": str(INPUT)}
+    reply, rest = send_request(serving.path, job)
+    assert reply["status"] == 2
+    assert reply["messages"].strip() == "psselect: page range 99 is invalid"
+    assert rest is not None
+
+
+def test_killed_worker(serving: Serving) -> None:
+    # A job whose worker dies fails, and later jobs run in a new pool
+    job = {"command": "psselect", "args": ["-p1"], "input": str(INPUT)}
+    reply, _ = send_request(serving.path, job)
+    assert reply["status"] == 0
+    executor = serving.server.executor
+    processes = executor._processes  # pylint: disable=protected-access
+    for process in list(processes.values()):
+        assert process.pid is not None
+        os.kill(process.pid, signal.SIGKILL)
+        process.join()
+    reply, rest = send_request(serving.path, job)
+    assert reply["status"] == 2
+    assert reply["messages"] == "psselect: worker process died\n"
+    assert rest == b""
+    assert serving.server.executor is not executor
+    reply, rest = send_request(serving.path, job)
+    assert reply["status"] == 0
+    assert rest is not None and len(rest) > 0
+
+
+def test_input_too_large(tmp_path: Path) -> None:
+    server = Serving(tmp_path, max_input_size=100)
+    try:
+        reply, rest = exchange(server, nup_job(101) + b"x" * 101)
+    finally:
+        server.close()
+    assert reply["status"] == 1
+    assert reply["messages"] == "invalid job: input_size is more than 100 bytes\n"
+    assert rest == b""
+
+
+def test_connection_limit(tmp_path: Path) -> None:
+    # While one connection is handled, the next waits
+    server = Serving(tmp_path, max_connections=1)
+    data = INPUT.read_bytes()
+    try:
+        with server.connect() as first, server.connect() as second:
+            first.sendall(nup_job(len(data)))
+            second.sendall(nup_job(len(data)) + data)
+            second.shutdown(socket.SHUT_WR)
+            second.settimeout(1)
+            with pytest.raises(socket.timeout):
+                second.recv(1)
+            first.sendall(data)
+            first.shutdown(socket.SHUT_WR)
+            with first.makefile("rb") as stream:
+                assert json.loads(stream.readline())["status"] == 0
+            second.settimeout(None)
+            with second.makefile("rb") as stream:
+                assert json.loads(stream.readline())["status"] == 0
+    finally:
+        server.close()
+
+
+def test_graceful_shutdown(tmp_path: Path) -> None:
+    # A request being handled when the server is closed is finished, and
+    # the socket is removed
+    server = Serving(tmp_path)
+    accepted = threading.Event()
+    process_request = server.server.process_request
+
+    def accept(request: Any, client_address: Any) -> None:
+        process_request(request, client_address)
+        accepted.set()
+
+    server.server.process_request = accept  # type: ignore[method-assign]
+    data = INPUT.read_bytes()
+    with server.connect() as s:
+        s.sendall(nup_job(len(data)) + data[:100])
+        accepted.wait()
+        closing = threading.Thread(target=server.close)
+        closing.start()
+        s.sendall(data[100:])
+        s.shutdown(socket.SHUT_WR)
+        with s.makefile("rb") as stream:
+            reply = json.loads(stream.readline())
+            output = stream.read()
+        closing.join()
+    assert reply["status"] == 0
+    assert len(output) == reply["output_size"] > 0
+    assert not Path(server.path).exists()
+    with pytest.raises(OSError):
+        server.connect()
@@ -0,0 +1,59 @@
+import os
+import sys
+import threading
+from pathlib import Path
+from typing import List
+
+import pytest
+from pytest import MonkeyPatch
+
+from psutils.command.psselect import psselect
+from psutils.transformers import PsTransform
+from psutils.types import Plan, Sheet
+
+TEST_FILES = Path(__file__).parent / "test-files"
+
+
+def test_pipe_streamed(tmp_path: Path, monkeypatch: MonkeyPatch) -> None:
+    # The first sheet is written before the rest of the input is read
+    indexed: List[bool] = []
+    write_sheet = PsTransform.write_sheet
+
+    def recording_write_sheet(self: PsTransform, plan: Plan, sheet: Sheet) -> None:
+        indexed.append(self.reader.indexed)
+        write_sheet(self, plan, sheet)
+
+    monkeypatch.setattr(PsTransform, "write_sheet", recording_write_sheet)
+    stdin_fd, pipe_fd = os.pipe()
+
+    def feed() -> None:
+        with open(pipe_fd, "wb") as pipe:
+            try:
+                pipe.write((TEST_FILES / "a4-20.ps").read_bytes())
+            except BrokenPipeError:
+                pass
+
+    threading.Thread(target=feed, daemon=True).start()
+    outfile = tmp_path / "output.ps"
+    with open(stdin_fd, "rb") as stdin:
+        monkeypatch.setattr(sys, "stdin", stdin)
+        psselect(["-q", "-p2-5", "-", str(outfile)])
+    assert indexed == [False] * 4
+    output = outfile.read_bytes()
+    assert b"%%Pages: (atend)" in output
+    assert b"%%Trailer\n%%Pages: 4 0\n" in output
+
+
+def test_file_pages_in_header(tmp_path: Path) -> None:
+    outfile = tmp_path / "output.ps"
+    psselect(["-q", "-p2-5", str(TEST_FILES / "a4-20.ps"), str(outfile)])
+    header = outfile.read_bytes().split(b"%%EndComments")[0]
+    assert b"%%Pages: 4 0\n" in header
+
+
+def test_file_invalid_range_writes_nothing(tmp_path: Path) -> None:
+    outfile = tmp_path / "output.ps"
+    with pytest.raises(SystemExit) as e:
+        psselect(["-q", "-p1,3-25", str(TEST_FILES / "a4-20.ps"), str(outfile)])
+    assert e.value.code == 2
+    assert outfile.read_bytes() == b""
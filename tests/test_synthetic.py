@@ -0,0 +1,35 @@
+import io
+
+from pypdf import PdfReader
+from pytest import mark, param
+
+from synthetic import Spec, write_document
+from psutils.api import select
+from psutils.readers import PsReader
+
+
+def page_count(document: bytes, file_type: str) -> int:
+    if file_type == ".pdf":
+        return len(PdfReader(io.BytesIO(document), strict=True).pages)
+    return PsReader(io.BytesIO(document)).total_pages()
+
+
+@mark.parametrize(
+    "spec",
+    [
+        param(Spec(5), id="plain"),
+        param(Spec(5, papers=[(595, 842), (842, 595)]), id="mixed-papers"),
+        param(Spec(5, prolog_size=10000, font=True, image=8), id="font-image"),
+        param(Spec(5, binary_data=1000), id="binary-data"),
+        param(Spec(5, newline=b"\r\n"), id="crlf"),
+        param(Spec(5, nested_document=True), id="nested-document"),
+    ],
+)
+def test_synthetic(spec: Spec, file_type: str) -> None:
+    buffer = io.BytesIO()
+    write_document(buffer, spec, file_type[1:])
+    document = buffer.getvalue()
+    assert page_count(document, file_type) == spec.pages
+    output = select(document, "2-4")
+    assert output is not None
+    assert page_count(output, file_type) == 3
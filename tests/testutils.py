@@ -4,9 +4,10 @@ import subprocess
 import re
 import difflib
 import shutil
+import threading
 from contextlib import ExitStack
 from pathlib import Path
-from dataclasses import dataclass
+from dataclasses import dataclass, field
 from unittest.mock import patch
 from typing import Any, Callable, List, Iterator, Optional, Union
 from warnings import warn
@@ -43,6 +44,12 @@ class Case:
     args: List[str]
     input: Union[GeneratedInput, str]
     error: Optional[int] = None
+    # Whether to read the input from a pipe
+    stdin: bool = False
+    # Inputs to give with --append
+    append: List[Union[GeneratedInput, str]] = field(default_factory=list)
+    # If non-zero, the number of files the output is split into
+    outputs: int = 0
 
 
 def remove_creation_date(lines: List[str]) -> List[str]:
@@ -117,6 +124,21 @@ def compare_strings(
     return compare_text_files(capsys, output_file, expected_file)
 
 
+# Return the path, without suffix, of test input `input_'.
+def input_file(
+    fixture_dir: Path, input_: Union[GeneratedInput, str], regenerate_input: bool
+) -> Path:
+    if isinstance(input_, str):
+        return fixture_dir / input_
+    basename = f"{input_.paper}-{input_.pages}"
+    if input_.border != 1:
+        basename += f"-{input_.border}"
+    test_file = fixture_dir / basename
+    if regenerate_input:
+        make_test_input(input_.paper, input_.pages, test_file, input_.border)
+    return test_file
+
+
 def file_test(
     function: Callable[[List[str]], None],
     case: Case,
@@ -134,37 +156,52 @@ def file_test(
     )
     if not os.path.exists(expected_stderr):
         expected_stderr = fixture_dir / module_name / case.name / "expected-stderr.txt"
-    if isinstance(case.input, str):
-        test_file = fixture_dir / case.input
-    else:
-        basename = f"{case.input.paper}-{case.input.pages}"
-        if case.input.border != 1:
-            basename += f"-{case.input.border}"
-        test_file = fixture_dir / basename
-    if regenerate_input and isinstance(case.input, GeneratedInput):
-        make_test_input(
-            case.input.paper, case.input.pages, test_file, case.input.border
-        )
+    test_file = input_file(fixture_dir, case.input, regenerate_input)
+    append_args = [
+        "--append="
+        + str(input_file(fixture_dir, i, regenerate_input).with_suffix(file_type))
+        for i in case.append
+    ]
     output_file = datafiles / "output"
-    full_args = [*case.args, str(test_file.with_suffix(file_type)), str(output_file)]
+    outputs = [(output_file, expected_file)]
+    if case.outputs > 0:
+        output_file = datafiles / "output-%d"
+        outputs = [
+            (datafiles / f"output-{n}", expected_file.with_name(f"expected-{n}"))
+            for n in range(1, case.outputs + 1)
+        ]
+    infile = "-" if case.stdin else str(test_file.with_suffix(file_type))
+    full_args = [*case.args, *append_args, infile, str(output_file)]
     patched_argv = [module_name, *(sys.argv[1:])]
-    with chdir(datafiles):
+    with chdir(datafiles), ExitStack() as stack:
+        if case.stdin:
+            stdin_fd, pipe_fd = os.pipe()
+            stdin = stack.enter_context(open(stdin_fd, "rb"))
+            stack.enter_context(patch("sys.stdin", stdin))
+
+            def feed() -> None:
+                with open(pipe_fd, "wb") as pipe:
+                    try:
+                        pipe.write(test_file.with_suffix(file_type).read_bytes())
+                    except BrokenPipeError:
+                        pass
+
+            threading.Thread(target=feed, daemon=True).start()
         correct_output = True
         if case.error is None:
             with patch("sys.argv", patched_argv):
                 function(full_args)
-            if regenerate_expected:
-                shutil.copyfile(output_file, expected_file.with_suffix(file_type))
-                correct_output = True
-            else:
-                comparer = (
-                    compare_text_files
-                    if file_type in (".ps", ".eps")
-                    else compare_image_files
-                )
-                correct_output = comparer(
-                    capsys, output_file, expected_file.with_suffix(file_type)
-                )
+            for output, expected in outputs:
+                if regenerate_expected:
+                    shutil.copyfile(output, expected.with_suffix(file_type))
+                else:
+                    comparer = (
+                        compare_text_files
+                        if file_type in (".ps", ".eps")
+                        else compare_image_files
+                    )
+                    if not comparer(capsys, output, expected.with_suffix(file_type)):
+                        correct_output = False
         else:
             with pytest.raises(SystemExit) as e:
                 with patch("sys.argv", patched_argv):